@@ -0,0 +1,253 @@
+/**
+ * Copyright (c) 2014, baskingshark
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __CallbackChain__
+#define __CallbackChain__
+
+#include <stdint.h>
+#include <string.h>
+
+#define CallbackChain baskingshark_CallbackChain
+
+/*!
+ * @class CallbackChain
+ *
+ * @abstract
+ * An ordered chain of rewriters and observers for a single value
+ *
+ * @discussion
+ * The callbacks (and their targets) are kept in a single contiguous array,
+ * sorted by decreasing priority, so that dispatch is one walk over the
+ * array.  Callbacks with the same priority run in the order they were added.
+ *
+ * The chain does not depend on libkern.  Everything specific to the objects
+ * it handles comes from Traits, which must provide:
+ *
+ *   Value, Target, Key     the types passed to callbacks
+ *   Rewrite, Observe       the callback types, returning Value and void
+ *   retain(o), release(o)  for targets and non-NULL values
+ *   alloc(n), free(p, n)   for the array of callbacks
+ *   rewrite(e, k, v)       call e->rewrite, see below
+ *   observe(e, k, v)       call e->observe
+ *
+ * Going through Traits::rewrite and Traits::observe lets the kext check each
+ * callback in debug builds, and lets the host tests build the same chain on
+ * plain objects.
+ *
+ * A CallbackChain is not locked.  Callbacks must not change the chain that
+ * invoked them.
+ */
+template<class Traits>
+class CallbackChain {
+public:
+    typedef typename Traits::Value   Value;
+    typedef typename Traits::Target  Target;
+    typedef typename Traits::Key     Key;
+    typedef typename Traits::Rewrite Rewrite;
+    typedef typename Traits::Observe Observe;
+
+    struct Entry {
+        Rewrite  rewrite;
+        Observe  observe;
+        Target   target;
+        int32_t  priority;
+        bool     final;
+    };
+
+    CallbackChain() : entries(NULL), count(0), capacity(0) {}
+    ~CallbackChain()
+    {
+        clear();
+    }
+
+    /*!
+     * @function add
+     *
+     * @abstract
+     * Add a rewriter or an observer to the chain
+     *
+     * @discussion
+     * Exactly one of rewrite and observe must be set.  If the same callback is
+     * already in the chain for target, it is moved to its new priority.
+     *
+     * @param rewrite   A callback that may replace the value.
+     * @param observe   A callback that only sees the value.
+     * @param target    Passed to the callback on each call.  It is retained.
+     * @param priority  Callbacks with a higher priority run first.
+     * @param final     Stop the chain if rewrite replaces the value.
+     */
+    bool add(Rewrite  rewrite,
+             Observe  observe,
+             Target   target,
+             int32_t  priority,
+             bool     final)
+    {
+        if(!target || !rewrite == !observe)
+            return false;
+
+        remove(rewrite, observe, target);
+        if(!ensureCapacity(count + 1))
+            return false;
+
+        unsigned int i = 0;
+        while(i < count && entries[i].priority >= priority)
+            i++;
+        memmove(&entries[i + 1], &entries[i], (count - i) * sizeof(Entry));
+        entries[i].rewrite = rewrite;
+        entries[i].observe = observe;
+        entries[i].target = target;
+        entries[i].priority = priority;
+        entries[i].final = final;
+        Traits::retain(target);
+        count++;
+        return true;
+    }
+
+    /*!
+     * @function remove
+     *
+     * @abstract
+     * Remove the entry for a callback and target
+     *
+     * @result true if the entry was found
+     */
+    bool remove(Rewrite rewrite, Observe observe, Target target)
+    {
+        for(unsigned int i = 0; i < count; i++) {
+            if(entries[i].rewrite == rewrite &&
+               entries[i].observe == observe &&
+               entries[i].target == target) {
+                count--;
+                memmove(&entries[i], &entries[i + 1],
+                        (count - i) * sizeof(Entry));
+                Traits::release(target);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /*!
+     * @function clear
+     *
+     * @abstract
+     * Remove all entries and free the array
+     */
+    void clear()
+    {
+        for(unsigned int i = 0; i < count; i++)
+            Traits::release(entries[i].target);
+        if(entries)
+            Traits::free(entries, capacity * sizeof(Entry));
+        entries = NULL;
+        count = 0;
+        capacity = 0;
+    }
+
+    /*!
+     * @function getCount
+     *
+     * @abstract
+     * Get the number of callbacks in the chain
+     */
+    unsigned int getCount() const
+    {
+        return count;
+    }
+
+    /*!
+     * @function invoke
+     *
+     * @abstract
+     * Run the chain on a value
+     *
+     * @discussion
+     * Each rewriter is passed the value returned by the previous one and
+     * each observer sees the value at its position in the chain.  The chain
+     * stops after a final rewriter replaces the value.
+     *
+     * A rewriter must return its argument retained, or a new value.
+     *
+     * @result The final value, retained
+     */
+    Value invoke(Key aKey, Value aValue) const
+    {
+        Value result = aValue;
+        if(result)
+            Traits::retain(result);
+        for(unsigned int i = 0; i < count; i++) {
+            const Entry *e = &entries[i];
+            if(e->observe) {
+                Traits::observe(e, aKey, result);
+                continue;
+            }
+            Value value = Traits::rewrite(e, aKey, result);
+            bool changed = value != result;
+            if(result)
+                Traits::release(result);
+            result = value;
+            if(changed && e->final)
+                break;
+        }
+        return result;
+    }
+
+    /*!
+     * @function ensureCapacity
+     *
+     * @abstract
+     * Grow the array of callbacks to hold at least n entries
+     */
+    bool ensureCapacity(unsigned int n)
+    {
+        if(n <= capacity)
+            return true;
+        unsigned int newCapacity = capacity ? capacity * 2 : 1;
+        while(newCapacity < n)
+            newCapacity *= 2;
+        Entry *newEntries =
+            static_cast<Entry*>(Traits::alloc(newCapacity * sizeof(Entry)));
+        if(!newEntries)
+            return false;
+        if(entries) {
+            memcpy(newEntries, entries, count * sizeof(Entry));
+            Traits::free(entries, capacity * sizeof(Entry));
+        }
+        entries = newEntries;
+        capacity = newCapacity;
+        return true;
+    }
+private:
+    CallbackChain(const CallbackChain&);
+    CallbackChain &operator=(const CallbackChain&);
+
+    Entry        *entries;
+    unsigned int  count;
+    unsigned int  capacity;
+};
+
+#endif /* defined(__CallbackChain__) */
@@ -0,0 +1,121 @@
+/**
+ * Copyright (c) 2014, baskingshark
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __Decision__
+#define __Decision__
+
+#include <string.h>
+
+/*
+ * Lookup in the decision table.
+ *
+ * The table is keyed by Model.  Each value is either a decision ("rewrite",
+ * "skip" or "ignore") or a table of decisions keyed by Revision, where
+ * DECISION_ANY_REVISION matches any revision not listed.
+ *
+ * lookupDecision works on any table type through its Traits, so the same code
+ * runs on the personality's OSDictionary and on host test tables.  Traits
+ * provide the types Table, Key and Value, where a missing Value is NULL, and:
+ *
+ *   get(table, key)       The value for key, or NULL
+ *   getAny(table)         The value for DECISION_ANY_REVISION, or NULL
+ *   asTable(value)        The value as a Table, or NULL if it is not one
+ *   asString(value)       The value as a C string, or NULL if it is not one
+ */
+
+// The Revision key that matches any revision not listed
+#define DECISION_ANY_REVISION "*"
+
+/*!
+ * @enum Decision
+ *
+ * @abstract
+ * What to do with a disk, as read from the decision table
+ */
+enum Decision {
+    kDecisionUnknown,   // Not in the table, inspect the Model
+    kDecisionRewrite,   // Hook and restart the target without inspection
+    kDecisionSkip,      // Attach without hooking the target
+    kDecisionIgnore     // Do not attach to the disk at all
+};
+
+/*!
+ * @function parseDecision
+ *
+ * @abstract
+ * Convert an entry of the decision table to a Decision
+ *
+ * @param value  The entry, may be NULL
+ *
+ * @result The decision, kDecisionUnknown if value is not one
+ */
+inline Decision parseDecision(const char *value)
+{
+    if(!value)
+        return kDecisionUnknown;
+    if(!strcmp(value, "rewrite"))
+        return kDecisionRewrite;
+    if(!strcmp(value, "skip"))
+        return kDecisionSkip;
+    if(!strcmp(value, "ignore"))
+        return kDecisionIgnore;
+    return kDecisionUnknown;
+}
+
+/*!
+ * @function lookupDecision
+ *
+ * @abstract
+ * Look up a disk in the decision table
+ *
+ * @param table     The decision table
+ * @param model     The Model of the disk
+ * @param revision  The Revision of the disk, may be NULL
+ *
+ * @result The decision for the disk, kDecisionUnknown if it is not listed
+ */
+template<class Traits>
+Decision lookupDecision(typename Traits::Table table,
+                        typename Traits::Key   model,
+                        typename Traits::Key   revision)
+{
+    typename Traits::Value entry = Traits::get(table, model);
+    if(!entry)
+        return kDecisionUnknown;
+
+    typename Traits::Table revisions = Traits::asTable(entry);
+    if(revisions) {
+        entry = revision ? Traits::get(revisions, revision) : NULL;
+        if(!entry)
+            entry = Traits::getAny(revisions);
+        if(!entry)
+            return kDecisionUnknown;
+    }
+    return parseDecision(Traits::asString(entry));
+}
+
+#endif /* defined(__Decision__) */
@@ -26,8 +26,13 @@
  */
 
 #include <libkern/c++/OSSymbol.h>
+#include <libkern/c++/OSCollectionIterator.h>
+#include <kern/clock.h>
 #include <IOKit/IOLib.h>
 #include "Dictionary.h"
+#include "CallbackChain.h"
+#include "MemStats.h"
+#include "Stats.h"
 
 #ifdef DEBUG
 #define DLOG(fmt, ...) IOLog(fmt, ## __VA_ARGS__)
@@ -35,49 +40,146 @@
 #define DLOG(fmt, ...)
 #endif
 
+#ifdef DEBUG
+// Budget for a single hook invocation.  Hooks run with the property lock
+// held, so anything slower is reported.
+static const uint64_t HOOK_TIME_BUDGET_NS = 100000;
+#endif
+
+#define HookChain baskingshark_HookChain
+#define HookChainTraits baskingshark_HookChainTraits
+
+/*!
+ * @class HookChainTraits
+ *
+ * @abstract
+ * Adapts CallbackChain to the callbacks of a Dictionary
+ *
+ * @discussion
+ * In debug builds, each callback is checked against its time budget and for
+ * mishandled references.
+ */
+struct HookChainTraits {
+    typedef const OSMetaClassBase      *Value;
+    typedef const OSObject             *Target;
+    typedef const OSSymbol             *Key;
+    typedef Dictionary::SetCallback     Rewrite;
+    typedef Dictionary::ObserveCallback Observe;
+
+    static void retain(const OSMetaClassBase *obj)
+    {
+        obj->retain();
+    }
+    static void release(const OSMetaClassBase *obj)
+    {
+        obj->release();
+    }
+    static void *alloc(vm_size_t size)
+    {
+        return memAlloc(kMemHookChain, size);
+    }
+    static void free(void *address, vm_size_t size)
+    {
+        memFree(kMemHookChain, address, size);
+    }
+    template<class Entry>
+    static Value rewrite(const Entry *e, Key aKey, Value aValue)
+    {
+#ifdef DEBUG
+        int refs = aValue ? aValue->getRetainCount() : 0;
+        uint64_t start = statsStart();
+        Value result = (*e->rewrite)(e->target, aKey, aValue);
+        check(aKey, aValue, refs, result, start);
+        return result;
+#else
+        return (*e->rewrite)(e->target, aKey, aValue);
+#endif
+    }
+    template<class Entry>
+    static void observe(const Entry *e, Key aKey, Value aValue)
+    {
+#ifdef DEBUG
+        int refs = aValue ? aValue->getRetainCount() : 0;
+        uint64_t start = statsStart();
+        (*e->observe)(e->target, aKey, aValue);
+        check(aKey, aValue, refs, NULL, start);
+#else
+        (*e->observe)(e->target, aKey, aValue);
+#endif
+    }
+#ifdef DEBUG
+    /*!
+     * @function check
+     *
+     * @abstract
+     * Report a callback that exceeded its budget or mishandled references
+     *
+     * @discussion
+     * A rewriter must return aValue retained or a new object, leaving the
+     * retain count of aValue otherwise untouched.  An observer (result is
+     * NULL) must leave it untouched.  Retain counts are only compared while
+     * something else holds aValue, so a callback that over-released it cannot
+     * have freed it.
+     */
+    static void check(const OSSymbol        *aKey,
+                      const OSMetaClassBase *aValue,
+                      int                    refs,
+                      const OSMetaClassBase *result,
+                      uint64_t               start)
+    {
+        uint64_t ns;
+        absolutetime_to_nanoseconds(statsStart() - start, &ns);
+        if(ns > HOOK_TIME_BUDGET_NS)
+            IOLog("%s - callback for '%s' took %llu ns\n",
+                  __FUNCTION__, aKey->getCStringNoCopy(), ns);
+        if(refs > 1) {
+            int expected = refs + (result == aValue ? 1 : 0);
+            int actual = aValue->getRetainCount();
+            if(actual != expected)
+                IOLog("%s - callback for '%s' changed retain count of %p "
+                      "from %d to %d, expected %d\n",
+                      __FUNCTION__, aKey->getCStringNoCopy(), aValue, refs,
+                      actual, expected);
+        }
+    }
+#endif
+};
+
 /*!
- * @class Callback
+ * @class HookChain
  *
  * @abstract
- * Callback provides an OSObject to store a function callback
+ * HookChain provides an OSObject to store the callbacks hooked on a key
  *
  * @discussion
- * This class is used to store callback functions (and an associated OSObject)
- * in an OSContainer.
+ * The callbacks are kept in a CallbackChain, see CallbackChain.h for the
+ * ordering and dispatch rules.
+ *
+ * Callbacks must not add or remove hooks on the Dictionary that invoked
+ * them.
  *
  * It is only intended to be used by the Dictionary class
  */
-class Callback : public OSObject
+class HookChain : public OSObject
 {
-    OSDeclareDefaultStructors(Callback);
+    OSDeclareDefaultStructors(HookChain);
 public:
     /*!
-     * @function withFunc
+     * @function withCapacity
      *
      * @abstract
-     * Create a Callback object for for the function specified
+     * Create an empty HookChain
      *
-     * @param f       A C function callback.
-     * @param target  An OSObject passed to the callback on each call.  It is
-     *                retained
+     * @param capacity  The number of callbacks to allocate space for
      *
-     * @result A new Callback with a retain count of 1 or NULL on failure
+     * @result A new HookChain with a retain count of 1 or NULL on failure
      */
-    static Callback *withFunc(Dictionary::SetCallback  f,
-                              const OSObject          *target)
+    static HookChain *withCapacity(unsigned int capacity)
     {
-        if(!target || !f)
-            return NULL;
-
-        Callback *me = OSTypeAlloc(Callback);
+        HookChain *me = OSTypeAlloc(HookChain);
         if(me) {
-            if(me->init()) {
-                me->f = f;
-                me->target = target;
-                if(target)
-                    target->retain();
-            }
-            else
+            memTrack(kMemHookChain, memSizeOf(me));
+            if(!me->init() || !me->chain.ensureCapacity(capacity))
                 OSSafeReleaseNULL(me);
         }
         return me;
@@ -93,28 +195,74 @@ public:
      */
     virtual void free()
     {
-        OSSafeRelease(target);
+        chain.clear();
+        memUntrack(kMemHookChain, memSizeOf(this));
         OSObject::free();
     }
     /*!
-     * @function invoke the callback
+     * @function add
      *
      * @abstract
-
+     * Add a rewriter or an observer to the chain
+     *
+     * @discussion
+     * See CallbackChain::add.
+     *
+     * @param options  Dictionary::kHookFinal or 0.
+     */
+    bool add(Dictionary::SetCallback      rewrite,
+             Dictionary::ObserveCallback  observe,
+             const OSObject              *target,
+             SInt32                       priority,
+             IOOptionBits                 options)
+    {
+        return chain.add(rewrite, observe, target, priority,
+                         (options & Dictionary::kHookFinal) != 0);
+    }
+    /*!
+     * @function remove
+     *
+     * @abstract
+     * Remove a rewriter or an observer from the chain
+     *
+     * @result true if the callback was in the chain for target
+     */
+    bool remove(Dictionary::SetCallback      rewrite,
+                Dictionary::ObserveCallback  observe,
+                const OSObject              *target)
+    {
+        return chain.remove(rewrite, observe, target);
+    }
+    /*!
+     * @function getCount
+     *
+     * @abstract
+     * Get the number of callbacks in the chain
+     */
+    unsigned int getCount() const
+    {
+        return chain.getCount();
+    }
+    /*!
+     * @function invoke
+     *
+     * @abstract
+     * Run the chain on a value
+     *
+     * @result The final value, retained
      */
-    virtual const OSMetaClassBase *invoke(const OSSymbol        *aKey,
-                                          const OSMetaClassBase *aValue) const
+    const OSMetaClassBase *invoke(const OSSymbol        *aKey,
+                                  const OSMetaClassBase *aValue) const
     {
-        return (*f)(target, aKey, aValue);
+        return chain.invoke(aKey, aValue);
     }
 private:
-    Dictionary::SetCallback  f;
-    const OSObject          *target;
+    CallbackChain<HookChainTraits> chain;
 };
 
 // This required macro defines the class's constructors, destructors,
 // and several other methods I/O Kit requires.
-OSDefineMetaClassAndStructors(Callback, OSObject);
+OSDefineMetaClassAndStructors(HookChain, OSObject);
 
 //
 // Dictionary
@@ -129,10 +277,38 @@ OSDefineMetaClassAndStructors(Dictionary, OSDictionary);
 
 void Dictionary::free()
 {
+    if(rewritten) {
+        OSCollectionIterator *iter =
+            OSCollectionIterator::withCollection(rewritten);
+        if(iter) {
+            const OSSymbol *aKey;
+            while((aKey = OSDynamicCast(OSSymbol, iter->getNextObject())))
+                memUntrack(kMemRewritten,
+                           memSizeOf(rewritten->getObject(aKey)));
+            iter->release();
+        }
+    }
+    // Nothing was accounted if withDictionary failed
+    if(tableBytes) {
+        memUntrack(kMemDictionary, tableBytes);
+        memUntrack(kMemHookTable, hookBytes);
+    }
     OSSafeRelease(hooks);
+    OSSafeRelease(rewritten);
+    OSSafeRelease(disabledBy);
     super::free();
 }
 
+void Dictionary::account()
+{
+    vm_size_t newTableBytes = memSizeOf(this);
+    vm_size_t newHookBytes = memSizeOf(hooks) + memSizeOf(rewritten);
+    memResize(kMemDictionary, tableBytes, newTableBytes);
+    memResize(kMemHookTable, hookBytes, newHookBytes);
+    tableBytes = newTableBytes;
+    hookBytes = newHookBytes;
+}
+
 bool Dictionary::setObject(const OSSymbol        *aKey,
                            const OSMetaClassBase *anObject)
 {
@@ -142,31 +318,58 @@ bool Dictionary::setObject(const OSSymbol        *aKey,
     DLOG("%s[%p]::%s(%s, %p)\n",
          getMetaClass()->getClassName(), this, __FUNCTION__,
          aKey->getCStringNoCopy(), anObject);
-    Callback *cb = static_cast<Callback*>(hooks->getObject(aKey));
+    HookChain *cb = hooksDisabled ? NULL :
+                    static_cast<HookChain*>(hooks->getObject(aKey));
+    // Both tables only grow, so the sum only changes if one of them did
+    unsigned int capacity = getCapacity() + rewritten->getCapacity();
     bool result;
     if(cb) {
-        DLOG("%s[%p]::%s - invoking callback for '%s' object @ %p\n",
+        DLOG("%s[%p]::%s - invoking callbacks for '%s' object @ %p\n",
              getMetaClass()->getClassName(), this, __FUNCTION__,
              aKey->getCStringNoCopy(), anObject);
+        statsCount(kStatsSetHookCalls);
         cb->retain();
-        anObject = cb->invoke(aKey, anObject);
+        const OSMetaClassBase *value = cb->invoke(aKey, anObject);
         cb->release();
-        DLOG("%s[%p]::%s - callback for '%s' returned object @ %p\n",
+        DLOG("%s[%p]::%s - callbacks for '%s' returned object @ %p\n",
              getMetaClass()->getClassName(), this, __FUNCTION__,
-             aKey->getCStringNoCopy(), anObject);
-        result = super::setObject(aKey, anObject);
-        OSSafeRelease(anObject);
+             aKey->getCStringNoCopy(), value);
+        result = super::setObject(aKey, value);
+        if(result) {
+            forgetRewritten(aKey);
+            // A new object made by the callbacks is held by this Dictionary
+            if(value != anObject && rewritten->setObject(aKey, value))
+                memTrack(kMemRewritten, memSizeOf(value));
+        }
+        OSSafeRelease(value);
     }
-    else
+    else {
         result = super::setObject(aKey, anObject);
+        if(result)
+            forgetRewritten(aKey);
+    }
+    if(getCapacity() + rewritten->getCapacity() != capacity)
+        account();
     return result;
 }
 
 void Dictionary::removeObject(const OSSymbol *aKey)
 {
+    forgetRewritten(aKey);
     super::removeObject(aKey);
 }
 
+void Dictionary::forgetRewritten(const OSSymbol *aKey)
+{
+    if(!rewritten->getCount())
+        return;
+    OSObject *value = rewritten->getObject(aKey);
+    if(value) {
+        memUntrack(kMemRewritten, memSizeOf(value));
+        rewritten->removeObject(aKey);
+    }
+}
+
 Dictionary *Dictionary::withDictionary(const OSDictionary *dict)
 {
     DLOG("%s::%s(%p)\n",
@@ -181,38 +384,97 @@ Dictionary *Dictionary::withDictionary(const OSDictionary *dict)
               __FUNCTION__,
               gMetaClass.getClassName());
         me->hooks = OSDictionary::withCapacity(1);
-        if(!me->hooks || !me->initWithDictionary(dict)) {
+        me->rewritten = OSDictionary::withCapacity(1);
+        if(!me->hooks || !me->rewritten || !me->initWithDictionary(dict)) {
             IOLog("%s::%s - failed to init\n",
                   gMetaClass.getClassName(), __FUNCTION__);
-            OSSafeRelease(me->hooks);
+            // Cleared so that free does not release them again
+            OSSafeReleaseNULL(me->hooks);
+            OSSafeReleaseNULL(me->rewritten);
             OSSafeReleaseNULL(me);
         }
         else {
             DLOG("%s::%s - inited\n", gMetaClass.getClassName(), __FUNCTION__);
+            me->tableBytes = memSizeOf(me);
+            me->hookBytes = memSizeOf(me->hooks) + memSizeOf(me->rewritten);
+            memTrack(kMemDictionary, me->tableBytes);
+            memTrack(kMemHookTable, me->hookBytes);
         }
     }
 
     return me;
 }
 
+bool Dictionary::addToChain(OSDictionary    *table,
+                            const OSSymbol  *aKey,
+                            const OSObject  *target,
+                            SetCallback      rewrite,
+                            ObserveCallback  observe,
+                            SInt32           priority,
+                            IOOptionBits     options)
+{
+    HookChain *chain = static_cast<HookChain*>(table->getObject(aKey));
+    if(chain)
+        chain->retain();
+    else {
+        chain = HookChain::withCapacity(1);
+        if(!chain)
+            return false;
+        if(!table->setObject(aKey, chain)) {
+            chain->release();
+            return false;
+        }
+    }
+    bool result = chain->add(rewrite, observe, target, priority, options);
+    // Don't leave behind an empty chain created for this call
+    if(!chain->getCount())
+        table->removeObject(aKey);
+    chain->release();
+    account();
+    return result;
+}
+
+bool Dictionary::removeFromChain(OSDictionary    *table,
+                                 const OSSymbol  *aKey,
+                                 const OSObject  *target,
+                                 SetCallback      rewrite,
+                                 ObserveCallback  observe)
+{
+    HookChain *chain = static_cast<HookChain*>(table->getObject(aKey));
+    if(!chain || !chain->remove(rewrite, observe, target))
+        return false;
+    if(!chain->getCount())
+        table->removeObject(aKey);
+    return true;
+}
+
 bool Dictionary::addHook(const OSSymbol *aKey,
                          const OSObject *target,
-                         SetCallback     cb
-                         )
+                         SetCallback     cb,
+                         SInt32          priority,
+                         IOOptionBits    options)
 {
     if(!aKey)
         return false;
 
-    DLOG("%s::%s('%s', %p, %p)\n",
+    DLOG("%s::%s('%s', %p, %p, %d, 0x%x)\n",
          getMetaClass()->getClassName(), __FUNCTION__,
-         aKey->getCStringNoCopy(), target, cb);
-    Callback *c = Callback::withFunc(cb, target);
-    if(c) {
-        bool result = hooks->setObject(aKey, c);
-        c->release();
-        return result;
-    }
-    return false;
+         aKey->getCStringNoCopy(), target, cb, priority, options);
+    return addToChain(hooks, aKey, target, cb, NULL, priority, options);
+}
+
+bool Dictionary::addObserver(const OSSymbol  *aKey,
+                             const OSObject  *target,
+                             ObserveCallback  cb,
+                             SInt32           priority)
+{
+    if(!aKey)
+        return false;
+
+    DLOG("%s::%s('%s', %p, %p, %d)\n",
+         getMetaClass()->getClassName(), __FUNCTION__,
+         aKey->getCStringNoCopy(), target, cb, priority);
+    return addToChain(hooks, aKey, target, NULL, cb, priority, 0);
 }
 
 void Dictionary::removeHook(const OSSymbol *aKey)
@@ -223,4 +485,55 @@ void Dictionary::removeHook(const OSSymbol *aKey)
          getMetaClass()->getClassName(), __FUNCTION__,
          aKey->getCStringNoCopy());
     hooks->removeObject(aKey);
-}
\ No newline at end of file
+}
+
+bool Dictionary::removeHook(const OSSymbol *aKey,
+                            const OSObject *target,
+                            SetCallback     cb)
+{
+    if(!aKey)
+        return false;
+
+    DLOG("%s::%s('%s', %p, %p)\n",
+         getMetaClass()->getClassName(), __FUNCTION__,
+         aKey->getCStringNoCopy(), target, cb);
+    return removeFromChain(hooks, aKey, target, cb, NULL);
+}
+
+bool Dictionary::removeObserver(const OSSymbol  *aKey,
+                                const OSObject  *target,
+                                ObserveCallback  cb)
+{
+    if(!aKey)
+        return false;
+
+    DLOG("%s::%s('%s', %p, %p)\n",
+         getMetaClass()->getClassName(), __FUNCTION__,
+         aKey->getCStringNoCopy(), target, cb);
+    return removeFromChain(hooks, aKey, target, NULL, cb);
+}
+
+void Dictionary::setHooksEnabled(bool enabled)
+{
+    DLOG("%s::%s(%d)\n",
+         getMetaClass()->getClassName(), __FUNCTION__, enabled);
+    hooksDisabled = !enabled;
+}
+
+bool Dictionary::getHooksEnabled() const
+{
+    return !hooksDisabled;
+}
+
+void Dictionary::setDisabledBy(OSObject *anObject)
+{
+    if(anObject)
+        anObject->retain();
+    OSSafeRelease(disabledBy);
+    disabledBy = anObject;
+}
+
+OSObject *Dictionary::getDisabledBy() const
+{
+    return disabledBy;
+}
@@ -106,33 +106,228 @@ public:
                                           const OSSymbol        *aKey,
                                           const OSMetaClassBase *anObject);
 
+    /*!
+     * @typedef ObserveCallback
+     *
+     * @param target    Reference supplied when the callback was registered.
+     * @param aKey      An OSSymbol identifying the object placed within the
+     *                  dictionary.
+     * @param anObject  The object about to be stored in the dictionary.  It
+     *                  must not be released.
+     */
+    typedef
+    void (*ObserveCallback)(const OSObject        *target,
+                            const OSSymbol        *aKey,
+                            const OSMetaClassBase *anObject);
+
+    /*!
+     * @enum HookOptions
+     *
+     * @constant kHookFinal  Stop the chain if the callback replaces the value.
+     */
+    enum HookOptions {
+        kHookFinal = 0x00000001
+    };
+
     /*!
      * @function addHook
      *
      * @abstract
-     * Set hook function for the given key.
+     * Add a hook function to the chain for the given key.
      *
-     * @param aKey    An OSSymbol identifying an object within the dictionary.
-     *                It is automatically retained.
-     * @param target  An OSObject passed to the callback on each call.  It is
-     *                retained.
-     * @param setCB   A C function callback to be called whenever aKey is
-     *                updated.
+     * @discussion
+     * Each key has a chain of callbacks run in order of decreasing priority,
+     * each being passed the value returned by the previous one.  Adding a
+     * callback that is already in the chain for target only updates its
+     * priority and options.
+     *
+     * @param aKey      An OSSymbol identifying an object within the
+     *                  dictionary.  It is automatically retained.
+     * @param target    An OSObject passed to the callback on each call.  It is
+     *                  retained.
+     * @param setCB     A C function callback to be called whenever aKey is
+     *                  updated.
+     * @param priority  Callbacks with a higher priority run first.
+     * @param options   kHookFinal or 0.
      */
     virtual bool addHook(const OSSymbol *aKey,
                          const OSObject *target,
-                         SetCallback     setCB);
+                         SetCallback     setCB,
+                         SInt32          priority = 0,
+                         IOOptionBits    options = 0);
+
+    /*!
+     * @function addObserver
+     *
+     * @abstract
+     * Add an observer to the chain for the given key.
+     *
+     * @discussion
+     * Observers see the value at their position in the chain but cannot
+     * change it.
+     *
+     * @param aKey      An OSSymbol identifying an object within the
+     *                  dictionary.  It is automatically retained.
+     * @param target    An OSObject passed to the callback on each call.  It is
+     *                  retained.
+     * @param observeCB A C function callback to be called whenever aKey is
+     *                  updated.
+     * @param priority  Callbacks with a higher priority run first.
+     */
+    virtual bool addObserver(const OSSymbol  *aKey,
+                             const OSObject  *target,
+                             ObserveCallback  observeCB,
+                             SInt32           priority = 0);
+
     /*!
      * @function removeHook
      *
      * @abstract
-     * Remove any hook function for the given key.
+     * Remove all hook functions and observers for the given key.
      *
      * @param aKey  An OSSymbol identifying an object within the dictionary.
      */
     virtual void removeHook(const OSSymbol *aKey);
+
+    /*!
+     * @function removeHook
+     *
+     * @abstract
+     * Remove a hook function added with addHook.
+     *
+     * @discussion
+     * Other callbacks for the key are kept.  Values already rewritten by the
+     * hook stay in the dictionary.
+     *
+     * @param aKey    An OSSymbol identifying an object within the dictionary.
+     * @param target  The target the hook was added with.  It is released.
+     * @param setCB   The hook function to remove.
+     *
+     * @result true if the hook was found and removed.
+     */
+    virtual bool removeHook(const OSSymbol *aKey,
+                            const OSObject *target,
+                            SetCallback     setCB);
+
+    /*!
+     * @function removeObserver
+     *
+     * @abstract
+     * Remove an observer added with addObserver.
+     *
+     * @discussion
+     * Other callbacks for the key are kept.
+     *
+     * @param aKey       An OSSymbol identifying an object within the
+     *                   dictionary.
+     * @param target     The target the observer was added with.  It is
+     *                   released.
+     * @param observeCB  The observer to remove.
+     *
+     * @result true if the observer was found and removed.
+     */
+    virtual bool removeObserver(const OSSymbol  *aKey,
+                                const OSObject  *target,
+                                ObserveCallback  observeCB);
+
+    /*!
+     * @function setHooksEnabled
+     *
+     * @abstract
+     * Enable or disable all hooks without removing them.
+     *
+     * @discussion
+     * While disabled, no callbacks are run and the dictionary behaves as a
+     * plain OSDictionary.  This is O(1).
+     *
+     * @param enabled  Whether hooks should be run.
+     */
+    void setHooksEnabled(bool enabled);
+
+    /*!
+     * @function getHooksEnabled
+     *
+     * @abstract
+     * Check whether hooks are currently enabled.
+     */
+    bool getHooksEnabled() const;
+
+    /*!
+     * @function setDisabledBy
+     *
+     * @abstract
+     * Record the object that disabled the hooks.
+     *
+     * @discussion
+     * The Dictionary does not use the object itself.  It is retained until
+     * it is replaced, cleared with NULL or the Dictionary is freed.
+     *
+     * @param anObject  The object to record, or NULL.
+     */
+    void setDisabledBy(OSObject *anObject);
+
+    /*!
+     * @function getDisabledBy
+     *
+     * @abstract
+     * Get the object recorded by setDisabledBy, or NULL.
+     */
+    OSObject *getDisabledBy() const;
 private:
+    /*!
+     * @function addToChain
+     *
+     * @abstract
+     * Add a rewriter or observer to the chain for aKey in table
+     */
+    bool addToChain(OSDictionary    *table,
+                    const OSSymbol  *aKey,
+                    const OSObject  *target,
+                    SetCallback      rewrite,
+                    ObserveCallback  observe,
+                    SInt32           priority,
+                    IOOptionBits     options);
+
+    /*!
+     * @function removeFromChain
+     *
+     * @abstract
+     * Remove a rewriter or observer from the chain for aKey in table
+     *
+     * @discussion
+     * The chain is dropped once it is empty.
+     */
+    bool removeFromChain(OSDictionary    *table,
+                         const OSSymbol  *aKey,
+                         const OSObject  *target,
+                         SetCallback      rewrite,
+                         ObserveCallback  observe);
+
+    /*!
+     * @function account
+     *
+     * @abstract
+     * Update the memory accounting for this Dictionary and its hook tables
+     * after they may have grown
+     */
+    void account();
+
+    /*!
+     * @function forgetRewritten
+     *
+     * @abstract
+     * Stop accounting the value stored under aKey as a rewritten one
+     */
+    void forgetRewritten(const OSSymbol *aKey);
+
     OSDictionary *hooks;
+    // Values stored in place of the ones set, keyed as in the Dictionary
+    OSDictionary *rewritten;
+    bool          hooksDisabled;
+    OSObject     *disabledBy;
+    // Bytes currently accounted for this Dictionary and its hook tables
+    vm_size_t     tableBytes;
+    vm_size_t     hookBytes;
 };
 
 #endif /* defined(__Dict__) */
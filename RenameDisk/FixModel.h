@@ -0,0 +1,113 @@
+/**
+ * Copyright (c) 2014, baskingshark
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __FixModel__
+#define __FixModel__
+
+#include <IOKit/IOLib.h>
+#include <libkern/c++/OSString.h>
+#include <libkern/c++/OSSymbol.h>
+#include "Rewrite.h"
+#include "Stats.h"
+
+#ifndef DLOG
+#ifdef DEBUG
+#define DLOG(fmt, ...) IOLog(fmt, ## __VA_ARGS__)
+#else
+#define DLOG(fmt, ...)
+#endif
+#endif
+
+/*!
+ * @function fixModelWith
+ *
+ * @abstract
+ * Change the model of a hard disk
+ *
+ * @discussion
+ * This is the body of the fixModel and fixConfiguredModel hooks, specialized
+ * for the prefix type.  If needed, it adds the required prefix to fool the
+ * IOAHCIBlockStorageDevice into believing that an Apple SSD is present.  This
+ * will enable Trim support if the real drive supports Trim.
+ *
+ * The Model comes from the drive, so anything longer than MAX_MODEL_LENGTH is
+ * left untouched rather than trusted to size the buffer.
+ *
+ * @param prefix    The prefix to add
+ * @param target    A pointer to the driver
+ * @param aKey      The name of the property being updated.  Should be "Model"
+ * @param anObject  The new value for the Model.  This should be an OSString.
+ *
+ * @result The new Model, updated if needed
+ */
+template<class Prefix>
+inline const OSMetaClassBase*
+fixModelWith(const Prefix          &prefix,
+             const OSObject        *target,
+             const OSSymbol        *aKey,
+             const OSMetaClassBase *anObject)
+{
+    const OSMetaClassBase *result = anObject;
+    const OSString *realModel = OSDynamicCast(OSString, anObject);
+    if(result)
+        result->retain();
+    if(realModel) {
+        const char *realModelCStr = realModel->getCStringNoCopy();
+        size_t len = realModel->getLength();
+        if(len > MAX_MODEL_LENGTH)
+            IOLog("%s[%p]::%s - Value is too long (%u) ... not updating\n",
+                  target->getMetaClass()->getClassName(), target,
+                  __FUNCTION__, realModel->getLength());
+        else if(!prefixMatches(prefix, realModelCStr, len)) {
+            char buffer[MAX_REWRITE_LENGTH];
+            rewriteModel(prefix, buffer, realModelCStr, len);
+            const OSString *newModel = OSString::withCString(buffer);
+            if(newModel) {
+                DLOG("%s[%p]::%s - Changing '%s' from '%s' to '%s'\n",
+                     target->getMetaClass()->getClassName(), target,
+                     __FUNCTION__,
+                     aKey->getCStringNoCopy(), realModelCStr, buffer);
+                OSSafeRelease(result);
+                result = newModel;
+                statsCount(kStatsRewrites);
+            }
+            else
+                IOLog("%s[%p]::%s - Failed to allocate new Model\n",
+                      target->getMetaClass()->getClassName(),
+                      target, __FUNCTION__);
+        }
+        else
+            DLOG("%s[%p]::%s - Prefix found ... not updating\n",
+                 target->getMetaClass()->getClassName(), target, __FUNCTION__);
+    }
+    else
+        IOLog("%s[%p]::%s - Value is not a string ... cannot update\n",
+              target->getMetaClass()->getClassName(), target, __FUNCTION__);
+    return result;
+}
+
+#endif /* defined(__FixModel__) */
@@ -0,0 +1,162 @@
+/**
+ * Copyright (c) 2014, baskingshark
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <libkern/OSAtomic.h>
+#include <libkern/c++/OSData.h>
+#include <libkern/c++/OSNumber.h>
+#include <libkern/c++/OSString.h>
+#include <IOKit/IOLib.h>
+#include "MemStats.h"
+
+struct MemCounters {
+    volatile SInt64 current;
+    volatile SInt64 peak;
+    volatile SInt64 allocs;
+    volatile SInt64 frees;
+};
+
+static MemCounters counters[kMemCategoryCount];
+
+// Names used when publishing, in MemCategory order
+static const char *CATEGORY_NAMES[kMemCategoryCount] = {
+    "Dictionary",
+    "Hook Tables",
+    "Hook Chains",
+    "Rewritten Values",
+};
+
+/*!
+ * @function adjust
+ *
+ * @abstract
+ * Add delta to the current bytes of a category and update its peak
+ */
+static void adjust(MemCategory category, SInt64 delta)
+{
+    MemCounters *c = &counters[category];
+    SInt64 now = OSAddAtomic64(delta, &c->current) + delta;
+    SInt64 peak = c->peak;
+    while(now > peak) {
+        if(OSCompareAndSwap64(peak, now,
+                              reinterpret_cast<volatile UInt64*>(&c->peak)))
+            break;
+        peak = c->peak;
+    }
+}
+
+void *memAlloc(MemCategory category, vm_size_t size)
+{
+    void *result = IOMalloc(size);
+    if(result)
+        memTrack(category, size);
+    return result;
+}
+
+void memFree(MemCategory category, void *address, vm_size_t size)
+{
+    if(!address)
+        return;
+    IOFree(address, size);
+    memUntrack(category, size);
+}
+
+void memTrack(MemCategory category, vm_size_t size)
+{
+    OSIncrementAtomic64(&counters[category].allocs);
+    adjust(category, size);
+}
+
+void memUntrack(MemCategory category, vm_size_t size)
+{
+    OSIncrementAtomic64(&counters[category].frees);
+    adjust(category, -static_cast<SInt64>(size));
+}
+
+void memResize(MemCategory category, vm_size_t oldSize, vm_size_t newSize)
+{
+    if(oldSize != newSize)
+        adjust(category,
+               static_cast<SInt64>(newSize) - static_cast<SInt64>(oldSize));
+}
+
+vm_size_t memSizeOf(const OSMetaClassBase *obj)
+{
+    if(!obj)
+        return 0;
+
+    vm_size_t result = obj->getMetaClass()->getClassSize();
+    const OSString *str;
+    const OSData *data;
+    const OSDictionary *dict;
+    if((str = OSDynamicCast(OSString, obj)))
+        result += str->getLength() + 1;
+    else if((data = OSDynamicCast(OSData, obj)))
+        result += data->getCapacity();
+    else if((dict = OSDynamicCast(OSDictionary, obj)))
+        // Each entry is a key and a value pointer
+        result += dict->getCapacity() * 2 * sizeof(void*);
+    return result;
+}
+
+/*!
+ * @function setNumber
+ *
+ * @abstract
+ * Store a 64 bit number in dict under key
+ */
+static bool setNumber(OSDictionary *dict, const char *key, SInt64 value)
+{
+    OSNumber *num = OSNumber::withNumber(static_cast<UInt64>(value), 64);
+    if(!num)
+        return false;
+    bool result = dict->setObject(key, num);
+    num->release();
+    return result;
+}
+
+OSDictionary *memCopyStats()
+{
+    OSDictionary *result = OSDictionary::withCapacity(kMemCategoryCount);
+    if(!result)
+        return NULL;
+
+    for(int i = 0; i < kMemCategoryCount; i++) {
+        OSDictionary *entry = OSDictionary::withCapacity(4);
+        if(!entry ||
+           !setNumber(entry, "Current Bytes", counters[i].current) ||
+           !setNumber(entry, "Peak Bytes", counters[i].peak) ||
+           !setNumber(entry, "Allocations", counters[i].allocs) ||
+           !setNumber(entry, "Frees", counters[i].frees) ||
+           !result->setObject(CATEGORY_NAMES[i], entry)) {
+            OSSafeRelease(entry);
+            OSSafeReleaseNULL(result);
+            break;
+        }
+        entry->release();
+    }
+    return result;
+}
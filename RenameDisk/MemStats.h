@@ -0,0 +1,125 @@
+/**
+ * Copyright (c) 2014, baskingshark
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __MemStats__
+#define __MemStats__
+
+#include <IOKit/IOTypes.h>
+#include <libkern/c++/OSDictionary.h>
+
+/*!
+ * @enum MemCategory
+ *
+ * @abstract
+ * Categories under which kernel memory held by the kext is accounted
+ */
+enum MemCategory {
+    kMemDictionary,     // Dictionary instances replacing property tables
+    kMemHookTable,      // Hook and value cache tables owned by a Dictionary
+    kMemHookChain,      // Hook chains and their callback arrays
+    kMemRewritten,      // Values made by set hooks and held by a Dictionary
+    kMemCategoryCount
+};
+
+/*!
+ * @function memAlloc
+ *
+ * @abstract
+ * IOMalloc wrapper that accounts the allocation under category
+ *
+ * @result The allocated memory or NULL on failure
+ */
+void *memAlloc(MemCategory category, vm_size_t size);
+
+/*!
+ * @function memFree
+ *
+ * @abstract
+ * IOFree wrapper for memory obtained from memAlloc
+ *
+ * @discussion
+ * category and size must match those passed to memAlloc
+ */
+void memFree(MemCategory category, void *address, vm_size_t size);
+
+/*!
+ * @function memTrack
+ *
+ * @abstract
+ * Account an object allocated elsewhere (e.g. with OSTypeAlloc)
+ */
+void memTrack(MemCategory category, vm_size_t size);
+
+/*!
+ * @function memUntrack
+ *
+ * @abstract
+ * Account the release of an object previously passed to memTrack
+ */
+void memUntrack(MemCategory category, vm_size_t size);
+
+/*!
+ * @function memResize
+ *
+ * @abstract
+ * Account the growth (or shrinkage) of a tracked object
+ *
+ * @discussion
+ * Only the byte counts are changed, the allocation counts are not.
+ */
+void memResize(MemCategory category, vm_size_t oldSize, vm_size_t newSize);
+
+/*!
+ * @function memSizeOf
+ *
+ * @abstract
+ * Estimate the memory used by an object
+ *
+ * @discussion
+ * The estimate is the size of the class plus the storage of OSString,
+ * OSData and OSDictionary instances.  It does not include allocator
+ * overhead.
+ *
+ * @result The estimated size in bytes, or 0 if obj is NULL
+ */
+vm_size_t memSizeOf(const OSMetaClassBase *obj);
+
+/*!
+ * @function memCopyStats
+ *
+ * @abstract
+ * Create a snapshot of the accounting for publishing in the registry
+ *
+ * @discussion
+ * The dictionary holds one entry per category, each with the current and
+ * peak bytes and the number of allocations and frees.
+ *
+ * @result A new OSDictionary with a retain count of 1 or NULL on failure
+ */
+OSDictionary *memCopyStats();
+
+#endif /* defined(__MemStats__) */
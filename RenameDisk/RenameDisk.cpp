@@ -26,8 +26,14 @@
  */
 
 #include <IOKit/IOLib.h>
+#include <IOKit/IOMessage.h>
+#include <libkern/OSKextLib.h>
 #include "RenameDisk.h"
 #include "Dictionary.h"
+#include "MemStats.h"
+#include "Stats.h"
+#include "Rewrite.h"
+#include "FixModel.h"
 
 #ifdef DEBUG
 #define DLOG(fmt, ...) IOLog(fmt, ## __VA_ARGS__)
@@ -52,76 +58,134 @@ static const char *TARGET = "IOAHCIBlockStorageDriver";
 static const char *MODEL = "Model";
 
 // The prefix that we add to the model
-static const char *PREFIX = "APPLE SSD";
+DECLARE_PREFIX(DefaultPrefix, "APPLE SSD");
+
+// The personality property that replaces the built-in prefix
+static const char *PREFIX_OVERRIDE = "RenameDisk Prefix";
+
+static_assert(DefaultPrefix().length() <= MAX_PREFIX_LENGTH,
+              "DefaultPrefix is longer than MAX_PREFIX_LENGTH");
+
+// The property used to identify a disk in the statistics page
+static const char *SERIAL = "Serial Number";
+
+// The property used to publish memory accounting
+static const char *MEMORY_STATS = "RenameDisk Memory";
+
+// The firmware revision of a disk
+static const char *REVISION = "Revision";
+
+// The personality property holding the precomputed decisions
+static const char *DECISIONS = "RenameDisk Decisions";
+
+// Set once the system starts to power off or restart.  Hooked property tables
+// are then left in place rather than replaced.
+static volatile bool shuttingDown = false;
 
 /*!
- * @function fixModel
+ * @function getConfiguredPrefix
  *
  * @abstract
- * Change the model of a hard disk
+ * Get the prefix configured in the personality, if any
  *
- * @discussion
- * This hook function is called whenever the Model number of a hard disk is
- * updated.  If needed, it adds the required prefix to fool the
- * IOAHCIBlockStorageDevice into believing that an Apple SSD is present.  This
- * will enable Trim support if the real drive supports Trim.
+ * @param target  A pointer to the driver
  *
- * @param target    A pointer to the driver
- * @param aKey      The name of the property being updated.  Should be "Model"
- * @param anObject  The new value for the Model.  This should be an OSString.
+ * @result
+ * The PREFIX_OVERRIDE property, or NULL if it is not set, is not a string or
+ * is longer than MAX_PREFIX_LENGTH.  The result is not retained.
+ */
+static const OSString *getConfiguredPrefix(const OSObject *target)
+{
+    const IOService *me = OSDynamicCast(IOService, target);
+    if(!me)
+        return NULL;
+    const OSString *result =
+        OSDynamicCast(OSString, me->getProperty(PREFIX_OVERRIDE));
+    if(result && result->getLength() > MAX_PREFIX_LENGTH)
+        result = NULL;
+    return result;
+}
+
+/*!
+ * @function hasPrefix
  *
- * @result The new Model, updated if needed
+ * @abstract
+ * Check whether a model already starts with the prefix used by the driver
  */
+static bool hasPrefix(const IOService *me, const OSString *model)
+{
+    const OSString *prefix = getConfiguredPrefix(me);
+    if(prefix)
+        return prefixMatches(RuntimePrefix(prefix->getCStringNoCopy(),
+                                           prefix->getLength()),
+                             model->getCStringNoCopy(), model->getLength());
+    return prefixMatches(DefaultPrefix(),
+                         model->getCStringNoCopy(), model->getLength());
+}
 
+/*!
+ * @function fixModel
+ *
+ * @abstract
+ * Change the model of a hard disk using the built-in prefix
+ *
+ * @discussion
+ * This hook function is called whenever the Model number of a hard disk is
+ * updated.  See fixModelWith.
+ */
 static const OSMetaClassBase*
 fixModel(const OSObject        *target,
          const OSSymbol        *aKey,
          const OSMetaClassBase *anObject)
 {
-    const OSMetaClassBase *result = anObject;
-    const OSString *realModel = OSDynamicCast(OSString, anObject);
-    if(result)
-        result->retain();
-    if(realModel) {
-        const char *realModelCStr = realModel->getCStringNoCopy();
-        if(strncmp(PREFIX, realModelCStr, strlen(PREFIX))) {
-            int required = snprintf(NULL, 0, "%s (%s)", PREFIX, realModelCStr);
-            if(required >= 0) {
-                required++; // Add extra space for NULL
-                char *buffer = static_cast<char*>(IOMalloc(required));
-                if(buffer) {
-                    snprintf(buffer, required,
-                             "%s (%s)", PREFIX, realModelCStr);
-                    const OSString *newModel = OSString::withCString(buffer);
-                    DLOG("%s[%p]::%s - Changing '%s' from '%s' to '%s'\n",
-                         target->getMetaClass()->getClassName(), target,
-                         __FUNCTION__,
-                         aKey->getCStringNoCopy(), realModelCStr, buffer);
-                    OSSafeRelease(result);
-                    result = newModel;
-                    IOFree(buffer, required);
-                }
-                else
-                    IOLog("%s[%p]::%s - Failed to allocate temporary buffer\n",
-                          target->getMetaClass()->getClassName(),
-                          target, __FUNCTION__);
-            }
-            else
-                IOLog("%s[%p]::%s - Failed to determine size of buffer\n",
-                      target->getMetaClass()->getClassName(),
-                      target, __FUNCTION__);
-        }
-        else
-            DLOG("%s[%p]::%s - Prefix found ... not updating\n",
-                 target->getMetaClass()->getClassName(), target, __FUNCTION__);
-    }
-    else
-        IOLog("%s[%p]::%s - Value is not a string ... cannot update\n",
-              target->getMetaClass()->getClassName(), target, __FUNCTION__);
-    return result;
+    return fixModelWith(DefaultPrefix(), target, aKey, anObject);
+}
+
+/*!
+ * @function fixConfiguredModel
+ *
+ * @abstract
+ * Change the model of a hard disk using the prefix from the personality
+ *
+ * @discussion
+ * As fixModel, but the prefix is only known at run time, so the generic
+ * matcher and formatter are used.
+ */
+static const OSMetaClassBase*
+fixConfiguredModel(const OSObject        *target,
+                   const OSSymbol        *aKey,
+                   const OSMetaClassBase *anObject)
+{
+    const OSString *prefix = getConfiguredPrefix(target);
+    if(!prefix)
+        return fixModel(target, aKey, anObject);
+    return fixModelWith(RuntimePrefix(prefix->getCStringNoCopy(),
+                                      prefix->getLength()),
+                        target, aKey, anObject);
 }
 
 #ifdef DEBUG
+/*!
+ * @function traceModel
+ *
+ * @abstract
+ * Log each Model set on the target
+ *
+ * @discussion
+ * This observer runs before fixModel in the chain, so it sees the Model as
+ * reported by the disk.
+ */
+static void traceModel(const OSObject        *target,
+                       const OSSymbol        *aKey,
+                       const OSMetaClassBase *anObject)
+{
+    const OSString *model = OSDynamicCast(OSString, anObject);
+    DLOG("%s[%p]::%s - '%s' set to '%s'\n",
+         target->getMetaClass()->getClassName(), target, __FUNCTION__,
+         aKey->getCStringNoCopy(),
+         model ? model->getCStringNoCopy() : "(not a string)");
+}
+
 #define DLOGDICT(prefix,dict,suffix)\
 do {\
     OSSerialize *ser = OSSerialize::withCapacity(4096);\
@@ -146,6 +210,10 @@ do {\
  * Dictionary and hooks changes to the "Model" property.  Any changes are
  * signalled by a call to the fixModel method.
  *
+ * The Model is rewritten as it is stored rather than when it is read, because
+ * IORegistryEntry::dictionaryWithProperties copies the stored values of the
+ * table without going through getObject.
+ *
  * This should only be called within a call to IOService::runPropertyAction()
  *
  * @param target  A pointer to self
@@ -194,7 +262,18 @@ hookProperties(OSObject *target,
             // Add hook
             const OSSymbol *model = OSSymbol::withCStringNoCopy(MODEL);
             if(model) {
-                propTable->addHook(model, target, fixModel);
+                const OSString *prefix = getConfiguredPrefix(me);
+                DLOG("%s[%p]::%s - Using %s prefix '%s'\n",
+                     me->getName(), me, __FUNCTION__,
+                     prefix ? "configured" : "built-in",
+                     prefix ? prefix->getCStringNoCopy() :
+                              DefaultPrefix().text());
+                propTable->addHook(model, target,
+                                   prefix ? fixConfiguredModel : fixModel);
+#ifdef DEBUG
+                // A higher priority than fixModel, to run before it
+                propTable->addObserver(model, target, traceModel, 1);
+#endif
                 model->release();
                 tgt->setPropertyTable(propTable);
                 result = kIOReturnSuccess;
@@ -229,13 +308,19 @@ hookProperties(OSObject *target,
  *
  * @discussion
  * This function replaces the property table on the target object with a
- * standard OSDictionary.
+ * standard OSDictionary.  The stored "Model" is already rewritten, so it is
+ * carried over to the new table as is.
+ *
+ * If arg1 is set, nothing is done unless the hooks are still disabled by
+ * that driver, that is, if they have been enabled again since stop disabled
+ * them.
  *
  * This should only be called within a call to IOService::runPropertyAction()
  *
  * @param target  A pointer to self
  * @param arg0    An IOService object to unhook
- * @param arg1    Unused
+ * @param arg1    The driver expected to have disabled the hooks, or NULL to
+ *                replace the property table regardless
  * @param arg2    Unused
  * @param arg3    Unused
  */
@@ -250,15 +335,25 @@ unhookProperties(OSObject *target,
     NewIOBlockStorageDriver *me =
         OSDynamicCast(NewIOBlockStorageDriver, target);
     IOService *tgt = static_cast<IOService*>(arg0);
+    OSObject *disabler = static_cast<OSObject*>(arg1);
 
     if(!me || !tgt)
         return kIOReturnInternalError;
 
-    DLOG("%s[%p]::%s(%p, %p)\n", me->getName(), me, __FUNCTION__, me, tgt);
+    DLOG("%s[%p]::%s(%p, %p, %p)\n",
+         me->getName(), me, __FUNCTION__, me, tgt, disabler);
 
     // Check that the current property table is one of ours.
     Dictionary *cur = OSDynamicCast(Dictionary, tgt->getPropertyTable());
-    if(cur) {
+    if(cur && disabler && cur->getDisabledBy() != disabler) {
+        DLOG("%s[%p]::%s - Hooks enabled again ... not replacing\n",
+             me->getName(), me, __FUNCTION__);
+    }
+    else if(cur) {
+        // Releases the reference the Dictionary holds on the driver, so a
+        // table that cannot be replaced does not keep the driver alive.  Its
+        // hooks stay disabled.
+        cur->setDisabledBy(NULL);
         DLOG("%s[%p]::%s - Replacing current property table @ %p",
              me->getName(), me, __FUNCTION__, cur);
         DLOGDICT(" = ", cur, "");
@@ -286,6 +381,164 @@ unhookProperties(OSObject *target,
     return kIOReturnSuccess;
 }
 
+/*!
+ * @function disableHooks
+ *
+ * @abstract
+ * Disable the hooks of a hookable Dictionary and schedule its replacement
+ *
+ * @discussion
+ * Unlike unhookProperties, the property table is left in place, so this is
+ * O(1).  The driver is recorded on the Dictionary if the replacement was
+ * scheduled, so that enableHooks can cancel it.
+ *
+ * This should only be called within a call to IOService::runPropertyAction()
+ *
+ * @param target  A pointer to self
+ * @param arg0    The hooked IOService
+ * @param arg1    Unused
+ * @param arg2    Unused
+ * @param arg3    Unused
+ */
+static
+IOReturn
+disableHooks(OSObject *target,
+             void     *arg0,
+             void     *arg1,
+             void     *arg2,
+             void     *arg3)
+{
+    NewIOBlockStorageDriver *me =
+        OSDynamicCast(NewIOBlockStorageDriver, target);
+    IOService *tgt = static_cast<IOService*>(arg0);
+
+    if(!me || !tgt)
+        return kIOReturnInternalError;
+
+    DLOG("%s[%p]::%s(%p, %p)\n", me->getName(), me, __FUNCTION__, me, tgt);
+    Dictionary *cur = OSDynamicCast(Dictionary, tgt->getPropertyTable());
+    if(!cur) {
+        IOLog("%s[%p]::%s - Property table for %s @ %p is not hooked\n",
+              me->getName(), me, __FUNCTION__, tgt->getName(), tgt);
+        return kIOReturnInternalError;
+    }
+    cur->setHooksEnabled(false);
+    // deferredUnhook waits for the property lock, so it sees the driver
+    if(me->scheduleUnhook(tgt))
+        cur->setDisabledBy(me);
+    return kIOReturnSuccess;
+}
+
+/*!
+ * @function enableHooks
+ *
+ * @abstract
+ * Enable the hooks of a hookable Dictionary again, if there is one
+ *
+ * @discussion
+ * Any replacement of the property table scheduled by the driver that
+ * disabled the hooks is cancelled.  If the thread call is already running,
+ * unhookProperties finds that the hooks are no longer disabled by that
+ * driver and leaves the table in place.
+ *
+ * This should only be called within a call to IOService::runPropertyAction()
+ *
+ * @param target  A pointer to self
+ * @param arg0    The IOService to check
+ * @param arg1    A pointer to a bool, set to whether arg0 is hooked
+ * @param arg2    Unused
+ * @param arg3    Unused
+ */
+static
+IOReturn
+enableHooks(OSObject *target,
+            void     *arg0,
+            void     *arg1,
+            void     *arg2,
+            void     *arg3)
+{
+    NewIOBlockStorageDriver *me =
+        OSDynamicCast(NewIOBlockStorageDriver, target);
+    IOService *tgt = static_cast<IOService*>(arg0);
+    bool *hooked = static_cast<bool*>(arg1);
+
+    if(!me || !tgt || !hooked)
+        return kIOReturnInternalError;
+
+    DLOG("%s[%p]::%s(%p, %p)\n", me->getName(), me, __FUNCTION__, me, tgt);
+    Dictionary *cur = OSDynamicCast(Dictionary, tgt->getPropertyTable());
+    *hooked = cur != NULL;
+    if(!cur)
+        return kIOReturnSuccess;
+    cur->setHooksEnabled(true);
+    NewIOBlockStorageDriver *prev =
+        OSDynamicCast(NewIOBlockStorageDriver, cur->getDisabledBy());
+    if(prev) {
+        // Clearing the Dictionary's reference may drop the last one
+        prev->retain();
+        cur->setDisabledBy(NULL);
+        prev->cancelUnhook(tgt);
+        prev->release();
+    }
+    return kIOReturnSuccess;
+}
+
+/*!
+ * @function deferredUnhook
+ *
+ * @abstract
+ * Replace a disabled Dictionary with a standard OSDictionary
+ *
+ * @discussion
+ * This thread call is scheduled by stop so that copying the property table
+ * does not delay termination.  The driver, the target and the kext are
+ * retained by scheduleUnhook and released here, or by cancelUnhook if the
+ * call is cancelled.
+ *
+ * @param param0  A pointer to the driver
+ * @param param1  The target IOService
+ */
+static void deferredUnhook(thread_call_param_t param0,
+                           thread_call_param_t param1)
+{
+    NewIOBlockStorageDriver *me =
+        static_cast<NewIOBlockStorageDriver*>(param0);
+    IOService *tgt = static_cast<IOService*>(param1);
+
+    DLOG("%s[%p]::%s(%p)\n", me->getName(), me, __FUNCTION__, tgt);
+    if(!shuttingDown) {
+        uint64_t start = statsStart();
+        tgt->runPropertyAction(unhookProperties, me, tgt, me);
+        statsPhase(kStatsPhaseUnhook, start);
+    }
+    tgt->release();
+    // May free the driver, and with it this thread call
+    me->release();
+    // Last, as the kext may be unloaded from here on
+    OSKextReleaseKextWithLoadTag(OSKextGetCurrentLoadTag());
+}
+
+/*!
+ * @function powerHandler
+ *
+ * @abstract
+ * Note when the system is about to power off or restart
+ */
+static IOReturn powerHandler(void      *target,
+                             void      *refCon,
+                             UInt32     messageType,
+                             IOService *provider,
+                             void      *messageArgument,
+                             vm_size_t  argSize)
+{
+    if(messageType == kIOMessageSystemWillPowerOff ||
+       messageType == kIOMessageSystemWillRestart) {
+        DLOG("%s - system is shutting down\n", __FUNCTION__);
+        shuttingDown = true;
+    }
+    return kIOReturnSuccess;
+}
+
 /*!
  * @function getTargetService
  *
@@ -338,14 +591,185 @@ IOService *getTargetService(IOService *me)
     return result;
 }
 
+/*!
+ * @function copyIdentity
+ *
+ * @abstract
+ * Copy the Model and Revision of a disk as reported by the disk
+ *
+ * @discussion
+ * Once the property table is hooked, the stored Model is the rewritten one.
+ *
+ * This should only be called within a call to IOService::runPropertyAction()
+ *
+ * @param target  A pointer to self
+ * @param arg0    The target IOService
+ * @param arg1    Where to store the Model.  It is retained, or set to NULL.
+ * @param arg2    Where to store the Revision.  It is retained, or set to NULL.
+ * @param arg3    Unused
+ */
+static
+IOReturn
+copyIdentity(OSObject *target,
+             void     *arg0,
+             void     *arg1,
+             void     *arg2,
+             void     *arg3)
+{
+    IOService *tgt = static_cast<IOService*>(arg0);
+    OSString **model = static_cast<OSString**>(arg1);
+    OSString **revision = static_cast<OSString**>(arg2);
+
+    if(!tgt || !model || !revision)
+        return kIOReturnInternalError;
+
+    OSDictionary *props = tgt->getPropertyTable();
+    if(!props)
+        return kIOReturnInternalError;
+    *model = OSDynamicCast(OSString, props->getObject(MODEL));
+    *revision = OSDynamicCast(OSString, props->getObject(REVISION));
+    if(*model)
+        (*model)->retain();
+    if(*revision)
+        (*revision)->retain();
+    return kIOReturnSuccess;
+}
+
+#define DecisionTraits baskingshark_DecisionTraits
+
+/*!
+ * @class DecisionTraits
+ *
+ * @abstract
+ * Adapts lookupDecision to the decision table of the personality
+ */
+struct DecisionTraits {
+    typedef const OSDictionary *Table;
+    typedef const OSString     *Key;
+    typedef const OSObject     *Value;
+
+    static Value get(Table table, Key key)
+    {
+        return table->getObject(key);
+    }
+    static Value getAny(Table table)
+    {
+        return table->getObject(DECISION_ANY_REVISION);
+    }
+    static Table asTable(Value value)
+    {
+        return OSDynamicCast(OSDictionary, value);
+    }
+    static const char *asString(Value value)
+    {
+        const OSString *str = OSDynamicCast(OSString, value);
+        return str ? str->getCStringNoCopy() : NULL;
+    }
+};
+
+/*!
+ * @function getDecision
+ *
+ * @abstract
+ * Look up the disk behind the target in the decision table
+ *
+ * @discussion
+ * The table is the DECISIONS property of the personality, in the format
+ * described in Decision.h.
+ *
+ * @param me   A pointer to self
+ * @param tgt  The target IOService
+ *
+ * @result The decision for the disk, kDecisionUnknown if it is not listed
+ */
+static Decision getDecision(IOService *me, IOService *tgt)
+{
+    OSDictionary *table = OSDynamicCast(OSDictionary,
+                                        me->getProperty(DECISIONS));
+    if(!table || !table->getCount())
+        return kDecisionUnknown;
+
+    OSString *model;
+    OSString *revision;
+    Decision result = kDecisionUnknown;
+    if(tgt->runPropertyAction(copyIdentity, me, tgt, &model, &revision) !=
+       kIOReturnSuccess)
+        return result;
+
+    if(model) {
+        result = lookupDecision<DecisionTraits>(table, model, revision);
+        DLOG("%s[%p]::%s - decision for '%s' (%s) is %d\n",
+             me->getName(), me, __FUNCTION__, model->getCStringNoCopy(),
+             revision ? revision->getCStringNoCopy() : "?", result);
+    }
+    OSSafeRelease(model);
+    OSSafeRelease(revision);
+    return result;
+}
+
+/*!
+ * @function needsHook
+ *
+ * @abstract
+ * Decide whether the target has to be hooked and restarted
+ *
+ * @discussion
+ * Disks listed in the decision table take the fast path.  For any other disk,
+ * the current Model is inspected and the target is only hooked if the Model
+ * does not already start with the prefix.
+ *
+ * @param me        A pointer to self
+ * @param tgt       The target IOService
+ * @param decision  The decision for the disk, as looked up by probe
+ *
+ * @result true if the target should be hooked and restarted
+ */
+static bool needsHook(IOService *me, IOService *tgt, Decision decision)
+{
+    switch(decision) {
+    case kDecisionRewrite:
+        return true;
+    case kDecisionSkip:
+    case kDecisionIgnore:
+        return false;
+    default:
+        break;
+    }
+
+    bool result = true;
+    OSObject *prop = tgt->copyProperty(MODEL);
+    OSString *model = OSDynamicCast(OSString, prop);
+    if(model && hasPrefix(me, model)) {
+        DLOG("%s[%p]::%s - Model '%s' already has prefix\n",
+             me->getName(), me, __FUNCTION__, model->getCStringNoCopy());
+        result = false;
+    }
+    OSSafeRelease(prop);
+    return result;
+}
+
 IOService *NewIOBlockStorageDriver::probe(IOService *provider,
                                           SInt32    *score)
 {
     DLOG("%s[%p]::%s(%p, %d)\n",
          getName(), this, __FUNCTION__, provider, *score);
+    uint64_t start = statsStart();
     IOService *result = super::probe(provider, score);
-    if(result && !getTargetService(this))
-        result = NULL;
+    if(result) {
+        IOService *tgt = getTargetService(this);
+        if(!tgt)
+            result = NULL;
+        else {
+            // Kept for start, so that the table is only searched once
+            decision = getDecision(this, tgt);
+            if(decision == kDecisionIgnore) {
+                DLOG("%s[%p]::%s - %s[%p] is listed as ignored\n",
+                     getName(), this, __FUNCTION__, tgt->getName(), tgt);
+                result = NULL;
+            }
+        }
+    }
+    statsPhase(kStatsPhaseProbe, start);
     return result;
 }
 
@@ -354,12 +778,28 @@ bool NewIOBlockStorageDriver::start(IOService *provider)
     DLOG("%s[%p]::%s(%p)\n", getName(), this, __FUNCTION__, provider);
     IOService *tgt = getTargetService(this);
     if(tgt) {
-        if(OSDynamicCast(Dictionary, tgt->getPropertyTable())) {
+        OSString *serial = OSDynamicCast(OSString, tgt->getProperty(SERIAL));
+        // Hooks may have been disabled by a previous stop.  The check and
+        // the re-enable are done under the property lock, so deferredUnhook
+        // cannot replace the table in between.
+        hooked = false;
+        if(tgt->runPropertyAction(enableHooks, this, tgt, &hooked) ==
+           kIOReturnSuccess && hooked) {
             DLOG("%s[%p]::%s - target (%s) is already hooked ... skipping\n",
                  getName(), this, __FUNCTION__, tgt->getName());
+            statsDiskState(serial, kStatsDiskRunning);
+        }
+        else if(!needsHook(this, tgt, decision)) {
+            DLOG("%s[%p]::%s - target (%s) does not need hooking ... "
+                 "skipping\n", getName(), this, __FUNCTION__, tgt->getName());
+            statsDiskState(serial, kStatsDiskRunning);
         }
         else {
             IOService *tgtParent = tgt->getProvider();
+            // serial is not retained, so record it before the target's
+            // properties are changed
+            statsDiskState(serial, kStatsDiskRestarting);
+            uint64_t phaseStart = statsStart();
             tgt->retain();
             // Target has opened provider ... close it
             if(tgtParent->isOpen(tgt)) {
@@ -372,18 +812,24 @@ bool NewIOBlockStorageDriver::start(IOService *provider)
             DLOG("%s[%p]::%s - Stopping %s[%p]\n",
                  getName(), this, __FUNCTION__, tgt->getName(), tgt);
             tgt->stop(tgtParent);
+            statsPhase(kStatsPhaseStopTarget, phaseStart);
             // Hook dictionary on target
             DLOG("%s[%p]::%s - patching property dict on %s[%p]\n",
                  getName(), this, __FUNCTION__, tgt->getName(), tgt);
+            phaseStart = statsStart();
             tgt->runPropertyAction(hookProperties, this, tgt);
+            statsPhase(kStatsPhaseHook, phaseStart);
             // Restart target
             DLOG("%s[%p]::%s - Restarting %s[%p] ... ",
                  getName(), this, __FUNCTION__, tgt->getName(), tgt);
+            phaseStart = statsStart();
             bool result = tgt->start(tgtParent);
             DLOG("%s\n", result ? "OK" : "FAILED");
+            statsPhase(kStatsPhaseRestart, phaseStart);
             tgt->release();
 
             // Terminate all services between us and the target
+            phaseStart = statsStart();
             IOService *p = provider;
             while(p != tgt) {
                 IOService *pParent = p->getProvider();
@@ -393,6 +839,7 @@ bool NewIOBlockStorageDriver::start(IOService *provider)
                 DLOG("%s\n", result ? "OK" : "FAILED");
                 p = pParent;
             }
+            statsPhase(kStatsPhaseTerminate, phaseStart);
             // Restarting target should have created a new device tree
             // We have also terminated our parents, grandparents, ...
             // So, fail to start
@@ -402,23 +849,113 @@ bool NewIOBlockStorageDriver::start(IOService *provider)
     else
         IOLog("%s[%p]::%s - target (%s) not found\n",
               getName(), this, __FUNCTION__, TARGET);
-    return super::start(provider);
+    if(!super::start(provider))
+        return false;
+    powerNotifier = registerPrioritySleepWakeInterest(powerHandler, this);
+    if(!powerNotifier)
+        IOLog("%s[%p]::%s - failed to register for power notifications\n",
+              getName(), this, __FUNCTION__);
+    return true;
+}
+
+bool NewIOBlockStorageDriver::serializeProperties(OSSerialize *s) const
+{
+    // Refresh the memory accounting so that every read sees current values
+    OSDictionary *stats = memCopyStats();
+    if(stats) {
+        const_cast<NewIOBlockStorageDriver*>(this)->setProperty(MEMORY_STATS,
+                                                                stats);
+        stats->release();
+    }
+    return super::serializeProperties(s);
 }
 
 void NewIOBlockStorageDriver::stop(IOService *provider)
 {
     DLOG("%s[%p]::%s(%p)\n", getName(), this, __FUNCTION__, provider);
+    if(powerNotifier) {
+        powerNotifier->remove();
+        powerNotifier = NULL;
+    }
     IOService *tgt = getTargetService(this);
     if(tgt) {
-        // Unhook dictionary on target
-        DLOG("%s[%p]::%s - unpatching property dict on %s[%p]\n",
-             getName(), this, __FUNCTION__, tgt->getName(), tgt);
+        uint64_t start = statsStart();
         tgt->retain();
-        tgt->runPropertyAction(unhookProperties, this, tgt);
+        if(hooked && !shuttingDown && !provider->isInactive()) {
+            // Only this driver is terminated, as when the kext is unloaded.
+            // The hooks run code of the kext, so the property table is
+            // replaced before returning.
+            DLOG("%s[%p]::%s - unhooking %s[%p]\n",
+                 getName(), this, __FUNCTION__, tgt->getName(), tgt);
+            tgt->runPropertyAction(unhookProperties, this, tgt, NULL);
+            statsPhase(kStatsPhaseUnhook, start);
+        }
+        else if(hooked) {
+            // Disable hooks on target, the property table is replaced later
+            DLOG("%s[%p]::%s - disabling hooks on %s[%p]\n",
+                 getName(), this, __FUNCTION__, tgt->getName(), tgt);
+            tgt->runPropertyAction(disableHooks, this, tgt);
+        }
+        else
+            DLOG("%s[%p]::%s - %s[%p] was not hooked ... nothing to disable\n",
+                 getName(), this, __FUNCTION__, tgt->getName(), tgt);
+        statsDiskState(OSDynamicCast(OSString, tgt->getProperty(SERIAL)),
+                       kStatsDiskStopped);
         tgt->release();
+        statsPhase(kStatsPhaseStop, start);
     }
     else
         IOLog("%s[%p]::%s - target (%s) not found\n",
               getName(), this, __FUNCTION__, TARGET);
     return super::stop(provider);
-}
\ No newline at end of file
+}
+
+bool NewIOBlockStorageDriver::scheduleUnhook(IOService *tgt)
+{
+    if(shuttingDown) {
+        DLOG("%s[%p]::%s - shutting down ... leaving property table\n",
+             getName(), this, __FUNCTION__);
+        return false;
+    }
+    if(!unhookCall)
+        unhookCall = thread_call_allocate(deferredUnhook, this);
+    if(!unhookCall) {
+        IOLog("%s[%p]::%s - failed to allocate thread call ... "
+              "leaving property table\n", getName(), this, __FUNCTION__);
+        return false;
+    }
+    // Released by deferredUnhook or cancelUnhook, so that the kext cannot be
+    // unloaded while the call is pending or running
+    if(OSKextRetainKextWithLoadTag(OSKextGetCurrentLoadTag()) !=
+       kOSReturnSuccess) {
+        IOLog("%s[%p]::%s - failed to retain kext ... "
+              "leaving property table\n", getName(), this, __FUNCTION__);
+        return false;
+    }
+    // Also released there.  stop is only called once, so the call cannot
+    // already be pending.
+    retain();
+    tgt->retain();
+    thread_call_enter1(unhookCall, tgt);
+    return true;
+}
+
+void NewIOBlockStorageDriver::cancelUnhook(IOService *tgt)
+{
+    if(unhookCall && thread_call_cancel(unhookCall)) {
+        DLOG("%s[%p]::%s - cancelled replacement of property table\n",
+             getName(), this, __FUNCTION__);
+        // The references deferredUnhook would have released.  The caller
+        // holds one on the driver.
+        tgt->release();
+        release();
+        OSKextReleaseKextWithLoadTag(OSKextGetCurrentLoadTag());
+    }
+}
+
+void NewIOBlockStorageDriver::free()
+{
+    if(unhookCall)
+        thread_call_free(unhookCall);
+    super::free();
+}
@@ -29,6 +29,8 @@
 #define __RenameDisk__
 
 #include <IOKit/storage/IOBlockStorageDriver.h>
+#include <kern/thread_call.h>
+#include "Decision.h"
 
 #define NewIOBlockStorageDriver baskingshark_IOBlockStorageDriver
 
@@ -39,7 +41,69 @@ public:
     virtual IOService *probe(IOService *provider,
                              SInt32 *score);
     virtual bool start(IOService *provider);
+
+    /*!
+     * @function stop
+     *
+     * @abstract
+     * Removes the hooks from the target
+     *
+     * @discussion
+     * If only this driver is terminated, as when the kext is unloaded, the
+     * hooked property table is replaced with a standard OSDictionary before
+     * returning, since its hooks run code of the kext.
+     *
+     * If the provider is terminated too, only the hooks are disabled, which
+     * is O(1).  The property table is then replaced later from a thread
+     * call, or left in place if the system is shutting down.
+     */
     virtual void stop(IOService *provide);
+    virtual void free();
+
+    /*!
+     * @function serializeProperties
+     *
+     * @abstract
+     * Refreshes the "RenameDisk Memory" property before serializing
+     *
+     * @discussion
+     * The property holds the current bytes, peak bytes and allocation counts
+     * of the kernel memory used by the kext, per category.
+     */
+    virtual bool serializeProperties(OSSerialize *s) const;
+
+    /*!
+     * @function scheduleUnhook
+     *
+     * @abstract
+     * Schedules the replacement of the property table of tgt
+     *
+     * @discussion
+     * Called with the property lock of tgt held.  Returns whether the
+     * replacement was scheduled.  The kext is retained until it is done or
+     * cancelled.
+     */
+    bool scheduleUnhook(IOService *tgt);
+
+    /*!
+     * @function cancelUnhook
+     *
+     * @abstract
+     * Cancels the replacement of the property table of tgt if it has not
+     * started yet
+     *
+     * @discussion
+     * Called with the property lock of tgt held, by a driver that enables
+     * the hooks again.  The caller must hold a reference on this driver.
+     */
+    void cancelUnhook(IOService *tgt);
+private:
+    IONotifier    *powerNotifier;
+    thread_call_t  unhookCall;
+    // Decision for the disk, looked up by probe
+    Decision       decision;
+    // Whether start found the target hooked, i.e. stop has hooks to remove
+    bool           hooked;
 };
 
 #endif /* defined(__RenameDisk__) */
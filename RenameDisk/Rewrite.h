@@ -0,0 +1,150 @@
+/**
+ * Copyright (c) 2014, baskingshark
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __Rewrite__
+#define __Rewrite__
+
+#include <stdint.h>
+#include <string.h>
+
+/*
+ * Matching and formatting of Model prefixes.
+ *
+ * A prefix is any type with text() and length() members.  Prefixes known at
+ * build time are declared with DECLARE_PREFIX, which makes length() a
+ * constant so that the compiler can fully unroll the functions below for
+ * that prefix.  Prefixes only known at run time, e.g. from the personality,
+ * use RuntimePrefix and get the generic version of the same code.
+ *
+ * A rewritten Model has the form "<prefix> (<model>)".
+ */
+
+// The longest prefix that can be configured
+static const unsigned int MAX_PREFIX_LENGTH = 32;
+
+// The longest Model that will be rewritten.  ATA reports 40 characters.
+static const unsigned int MAX_MODEL_LENGTH = 128;
+
+// Space needed by rewriteModel for the longest prefix and Model
+static const size_t MAX_REWRITE_LENGTH = MAX_PREFIX_LENGTH +
+                                         MAX_MODEL_LENGTH + 4;
+
+/*!
+ * @defined DECLARE_PREFIX
+ *
+ * @abstract
+ * Declare a prefix type for a string literal
+ */
+#define DECLARE_PREFIX(name, str)                                          \
+struct name {                                                              \
+    const char *text() const { return str; }                               \
+    constexpr size_t length() const { return sizeof(str) - 1; }            \
+}
+
+/*!
+ * @class RuntimePrefix
+ *
+ * @abstract
+ * A prefix whose text is only known at run time
+ *
+ * @discussion
+ * The text is not copied and must outlive the RuntimePrefix.
+ */
+class RuntimePrefix {
+public:
+    RuntimePrefix(const char *text, size_t length)
+        : txt(text), len(length) {}
+    const char *text() const { return txt; }
+    size_t length() const { return len; }
+private:
+    const char *txt;
+    size_t      len;
+};
+
+/*!
+ * @function prefixMatches
+ *
+ * @abstract
+ * Check whether s starts with prefix
+ *
+ * @discussion
+ * The comparison is done a word at a time, followed by the remaining bytes.
+ * No byte beyond s[len - 1] is read.
+ *
+ * @param prefix  The prefix to look for
+ * @param s       The string to check
+ * @param len     The length of s
+ */
+template<class Prefix>
+inline bool prefixMatches(const Prefix &prefix, const char *s, size_t len)
+{
+    const size_t plen = prefix.length();
+    if(len < plen)
+        return false;
+
+    const char *p = prefix.text();
+    size_t i = 0;
+    for(; i + sizeof(uint64_t) <= plen; i += sizeof(uint64_t)) {
+        uint64_t a, b;
+        memcpy(&a, p + i, sizeof(a));
+        memcpy(&b, s + i, sizeof(b));
+        if(a != b)
+            return false;
+    }
+    for(; i < plen; i++)
+        if(p[i] != s[i])
+            return false;
+    return true;
+}
+
+/*!
+ * @function rewriteModel
+ *
+ * @abstract
+ * Format "<prefix> (<model>)" into buffer
+ *
+ * @param prefix  The prefix to add
+ * @param buffer  Space for at least prefix.length() + len + 4 bytes
+ * @param model   The Model to rewrite
+ * @param len     The length of model
+ */
+template<class Prefix>
+inline void rewriteModel(const Prefix &prefix,
+                         char         *buffer,
+                         const char   *model,
+                         size_t        len)
+{
+    const size_t plen = prefix.length();
+    memcpy(buffer, prefix.text(), plen);
+    buffer[plen] = ' ';
+    buffer[plen + 1] = '(';
+    memcpy(buffer + plen + 2, model, len);
+    buffer[plen + 2 + len] = ')';
+    buffer[plen + 3 + len] = '\0';
+}
+
+#endif /* defined(__Rewrite__) */
@@ -0,0 +1,177 @@
+/**
+ * Copyright (c) 2014, baskingshark
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <kern/clock.h>
+#include <mach/vm_param.h>
+#include <IOKit/IOLib.h>
+#include <IOKit/IOBufferMemoryDescriptor.h>
+#include "Stats.h"
+
+/*!
+ * @class StatsStorage
+ *
+ * @abstract
+ * Owns the statistics page and the lock serializing its writers
+ *
+ * @discussion
+ * The only instance is a static object, so it is created when the kext is
+ * loaded and freed when it is unloaded.  The page is allocated on its own so
+ * that mapping it into user space does not expose any other kernel data.
+ *
+ * If either allocation fails, updates are dropped and no page is mapped.
+ */
+static class StatsStorage {
+public:
+    StatsStorage()
+        : buffer(IOBufferMemoryDescriptor::withOptions(
+                     kIOMemoryKernelUserShared, round_page(sizeof(StatsPage)),
+                     page_size)),
+          lock(IOSimpleLockAlloc()),
+          page(NULL)
+    {
+        if(!buffer || !lock) {
+            IOLog("%s - failed to allocate statistics page\n", __FUNCTION__);
+            return;
+        }
+        page = static_cast<StatsPage*>(buffer->getBytesNoCopy());
+        bzero(page, buffer->getLength());
+        page->version = RENAMEDISK_STATS_VERSION;
+        page->size = sizeof(StatsPage);
+    }
+    ~StatsStorage()
+    {
+        OSSafeRelease(buffer);
+        if(lock)
+            IOSimpleLockFree(lock);
+    }
+    IOBufferMemoryDescriptor *buffer;
+    IOSimpleLock             *lock;
+    StatsPage                *page;
+} storage;
+
+/*!
+ * @function beginWrite
+ *
+ * @abstract
+ * Take the writer lock and make the sequence number odd
+ *
+ * @discussion
+ * IOSimpleLockLock disables preemption, so a writer cannot be descheduled
+ * while readers are waiting for the sequence number to become even.  The
+ * sequence number is only there for the readers.
+ *
+ * @result The page to update, or NULL if there is none
+ */
+static StatsPage *beginWrite()
+{
+    StatsPage *page = storage.page;
+    if(!page)
+        return NULL;
+    IOSimpleLockLock(storage.lock);
+    statsPageBeginWrite(page);
+    return page;
+}
+
+/*!
+ * @function endWrite
+ *
+ * @abstract
+ * Make the sequence number even and release the lock taken by beginWrite
+ */
+static void endWrite(StatsPage *page)
+{
+    statsPageEndWrite(page);
+    IOSimpleLockUnlock(storage.lock);
+}
+
+void statsCount(StatsCounter counter)
+{
+    StatsPage *page = beginWrite();
+    if(!page)
+        return;
+    page->counters[counter]++;
+    endWrite(page);
+}
+
+uint64_t statsStart()
+{
+    uint64_t now;
+    clock_get_uptime(&now);
+    return now;
+}
+
+void statsPhase(StatsPhase phase, uint64_t start)
+{
+    uint64_t ns;
+    absolutetime_to_nanoseconds(statsStart() - start, &ns);
+
+    StatsPage *page = beginWrite();
+    if(!page)
+        return;
+    StatsPhaseTimes *times = &page->phases[phase];
+    times->count++;
+    times->totalNs += ns;
+    if(ns > times->maxNs)
+        times->maxNs = ns;
+    endWrite(page);
+}
+
+void statsDiskState(const OSString *serial, StatsDiskState state)
+{
+    if(!serial)
+        return;
+
+    const char *serialCStr = serial->getCStringNoCopy();
+    StatsPage *page = beginWrite();
+    if(!page)
+        return;
+    StatsDisk *disk = NULL;
+    for(uint32_t i = 0; i < page->diskCount; i++) {
+        if(!strncmp(page->disks[i].serial, serialCStr,
+                    RENAMEDISK_STATS_SERIAL_LEN - 1)) {
+            disk = &page->disks[i];
+            break;
+        }
+    }
+    if(!disk && page->diskCount < RENAMEDISK_STATS_MAX_DISKS) {
+        disk = &page->disks[page->diskCount++];
+        strlcpy(disk->serial, serialCStr, sizeof(disk->serial));
+    }
+    if(disk) {
+        if(state == kStatsDiskRestarting)
+            disk->restarts++;
+        disk->state = state;
+    }
+    endWrite(page);
+}
+
+IOMemoryDescriptor *statsCopyDescriptor()
+{
+    if(storage.buffer)
+        storage.buffer->retain();
+    return storage.buffer;
+}
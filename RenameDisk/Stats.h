@@ -0,0 +1,87 @@
+/**
+ * Copyright (c) 2014, baskingshark
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __Stats__
+#define __Stats__
+
+#include <IOKit/IOMemoryDescriptor.h>
+#include <libkern/c++/OSString.h>
+#include "StatsPage.h"
+
+/*!
+ * @function statsCount
+ *
+ * @abstract
+ * Increment one of the counters in the statistics page
+ */
+void statsCount(StatsCounter counter);
+
+/*!
+ * @function statsStart
+ *
+ * @abstract
+ * Get the start time of a phase, to be passed to statsPhase
+ */
+uint64_t statsStart();
+
+/*!
+ * @function statsPhase
+ *
+ * @abstract
+ * Record the time spent in a phase that began at start
+ */
+void statsPhase(StatsPhase phase, uint64_t start);
+
+/*!
+ * @function statsDiskState
+ *
+ * @abstract
+ * Record the state of the disk with the given serial number
+ *
+ * @discussion
+ * A slot is claimed for a disk the first time it is seen.  Disks without a
+ * serial number, or beyond RENAMEDISK_STATS_MAX_DISKS, are not tracked.
+ */
+void statsDiskState(const OSString *serial, StatsDiskState state);
+
+/*!
+ * @function statsCopyDescriptor
+ *
+ * @abstract
+ * Get the memory descriptor of the statistics page
+ *
+ * @discussion
+ * The page was allocated with kIOMemoryKernelUserShared and is a whole
+ * number of pages, so it can be mapped into user space as is.
+ *
+ * @result
+ * The IOMemoryDescriptor, retained, or NULL if the page could not be
+ * allocated
+ */
+IOMemoryDescriptor *statsCopyDescriptor();
+
+#endif /* defined(__Stats__) */
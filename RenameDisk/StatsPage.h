@@ -0,0 +1,127 @@
+/**
+ * Copyright (c) 2014, baskingshark
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __StatsPage__
+#define __StatsPage__
+
+/*
+ * Layout of the statistics page shared between the kext and user space.
+ *
+ * This header is included by both the kext and user space readers, so it
+ * must only use plain C.
+ *
+ * The page is protected by a sequence lock.  The kext makes sequence odd
+ * before updating the page and even again afterwards, with writers
+ * serialized by a lock of their own, see statsPageBeginWrite and
+ * statsPageEndWrite.  A reader copies the page and retries if sequence was
+ * odd or changed during the copy.
+ *
+ * The mapping is rounded up to a whole number of pages, size gives the
+ * number of bytes actually used.
+ */
+
+#include <stdint.h>
+
+// Version of the layout below, bumped on incompatible changes
+#define RENAMEDISK_STATS_VERSION        3
+
+// Memory type to pass to IOConnectMapMemory
+#define RENAMEDISK_STATS_MEMORY_TYPE    0
+
+// Number of disks that can be tracked
+#define RENAMEDISK_STATS_MAX_DISKS      16
+
+// Space for the serial number of a disk, including NULL
+#define RENAMEDISK_STATS_SERIAL_LEN     32
+
+typedef enum {
+    kStatsSetHookCalls,     // Set hooks invoked
+    kStatsRewrites,         // Models rewritten by fixModel
+    kStatsCounterCount
+} StatsCounter;
+
+typedef enum {
+    kStatsPhaseProbe,       // NewIOBlockStorageDriver::probe
+    kStatsPhaseStopTarget,  // Stopping the target before hooking
+    kStatsPhaseHook,        // Replacing the property table
+    kStatsPhaseRestart,     // Restarting the target
+    kStatsPhaseTerminate,   // Terminating the services above the target
+    kStatsPhaseUnhook,      // Restoring the property table
+    kStatsPhaseStop,        // Disabling the hooks on stop
+    kStatsPhaseCount
+} StatsPhase;
+
+typedef enum {
+    kStatsDiskUnused,       // Slot is free
+    kStatsDiskRestarting,   // Target being hooked and restarted
+    kStatsDiskRunning,      // Driver attached to a hooked target
+    kStatsDiskStopped       // Driver stopped
+} StatsDiskState;
+
+typedef struct {
+    uint64_t count;
+    uint64_t totalNs;
+    uint64_t maxNs;
+} StatsPhaseTimes;
+
+typedef struct {
+    uint32_t state;         // StatsDiskState
+    uint32_t restarts;
+    char     serial[RENAMEDISK_STATS_SERIAL_LEN];
+} StatsDisk;
+
+typedef struct {
+    uint32_t          version;
+    uint32_t          size;
+    volatile uint32_t sequence;
+    uint32_t          diskCount;
+    uint64_t          counters[kStatsCounterCount];
+    StatsPhaseTimes   phases[kStatsPhaseCount];
+    StatsDisk         disks[RENAMEDISK_STATS_MAX_DISKS];
+} StatsPage;
+
+/*
+ * Make sequence odd before a writer updates the page.  The caller must hold
+ * the lock serializing writers.
+ */
+static inline void statsPageBeginWrite(volatile StatsPage *page)
+{
+    page->sequence++;
+    __sync_synchronize();
+}
+
+/*
+ * Make sequence even again once the update is complete, before releasing
+ * the writers' lock.
+ */
+static inline void statsPageEndWrite(volatile StatsPage *page)
+{
+    __sync_synchronize();
+    page->sequence++;
+}
+
+#endif /* defined(__StatsPage__) */
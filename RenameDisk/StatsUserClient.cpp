@@ -0,0 +1,70 @@
+/**
+ * Copyright (c) 2014, baskingshark
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <IOKit/IOLib.h>
+#include "StatsUserClient.h"
+#include "Stats.h"
+
+#ifdef DEBUG
+#define DLOG(fmt, ...) IOLog(fmt, ## __VA_ARGS__)
+#else
+#define DLOG(fmt, ...)
+#endif
+
+// This required macro defines the class's constructors, destructors,
+// and several other methods I/O Kit requires.
+OSDefineMetaClassAndStructors(StatsUserClient, IOUserClient);
+
+// Define the driver's superclass.
+#define super IOUserClient
+
+IOReturn StatsUserClient::clientClose()
+{
+    DLOG("%s[%p]::%s()\n", getName(), this, __FUNCTION__);
+    terminate();
+    return kIOReturnSuccess;
+}
+
+IOReturn StatsUserClient::clientMemoryForType(UInt32               type,
+                                              IOOptionBits        *options,
+                                              IOMemoryDescriptor **memory)
+{
+    DLOG("%s[%p]::%s(%u)\n", getName(), this, __FUNCTION__, type);
+    if(type != RENAMEDISK_STATS_MEMORY_TYPE)
+        return kIOReturnBadArgument;
+
+    IOMemoryDescriptor *desc = statsCopyDescriptor();
+    if(!desc) {
+        IOLog("%s[%p]::%s - Statistics page not allocated\n",
+              getName(), this, __FUNCTION__);
+        return kIOReturnNoMemory;
+    }
+    // The caller releases the descriptor
+    *memory = desc;
+    *options = kIOMapReadOnly;
+    return kIOReturnSuccess;
+}
@@ -0,0 +1,56 @@
+/**
+ * Copyright (c) 2014, baskingshark
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __StatsUserClient__
+#define __StatsUserClient__
+
+#include <IOKit/IOUserClient.h>
+
+#define StatsUserClient baskingshark_StatsUserClient
+
+/*!
+ * @class StatsUserClient
+ *
+ * @abstract
+ * User client giving read-only access to the statistics page
+ *
+ * @discussion
+ * The only service offered is mapping the page described in StatsPage.h with
+ * IOConnectMapMemory, using RENAMEDISK_STATS_MEMORY_TYPE.  Once mapped, the
+ * page can be sampled without any further calls into the kernel.
+ */
+class StatsUserClient : public IOUserClient
+{
+    OSDeclareDefaultStructors(StatsUserClient);
+public:
+    virtual IOReturn clientClose();
+    virtual IOReturn clientMemoryForType(UInt32                type,
+                                         IOOptionBits         *options,
+                                         IOMemoryDescriptor  **memory);
+};
+
+#endif /* defined(__StatsUserClient__) */
@@ -0,0 +1,120 @@
+/*
+ * Copyright (c) 2014, baskingshark
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ *  rdstat.c
+ *
+ *  Sample the statistics page published by RenameDisk.kext.
+ *
+ *  Build with:
+ *      make rdstat
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <IOKit/IOKitLib.h>
+#include "statsread.h"
+
+// Class of the service providing the user client
+static const char *SERVICE = "baskingshark_IOBlockStorageDriver";
+
+static void usage(const char *name)
+{
+    fprintf(stderr, "usage: %s [-i interval] [-n count]\n", name);
+    exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned interval = 1;
+    long count = -1;
+    int ch;
+    while((ch = getopt(argc, argv, "i:n:")) != -1) {
+        switch(ch) {
+        case 'i':
+            interval = (unsigned) strtoul(optarg, NULL, 10);
+            break;
+        case 'n':
+            count = strtol(optarg, NULL, 10);
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+
+    io_service_t service =
+        IOServiceGetMatchingService(kIOMasterPortDefault,
+                                    IOServiceMatching(SERVICE));
+    if(!service) {
+        fprintf(stderr, "%s: no %s found\n", argv[0], SERVICE);
+        return 1;
+    }
+    io_connect_t connect;
+    kern_return_t kr = IOServiceOpen(service, mach_task_self(), 0, &connect);
+    IOObjectRelease(service);
+    if(kr != KERN_SUCCESS) {
+        fprintf(stderr, "%s: IOServiceOpen failed (0x%x)\n", argv[0], kr);
+        return 1;
+    }
+    mach_vm_address_t address = 0;
+    mach_vm_size_t size = 0;
+    kr = IOConnectMapMemory64(connect, RENAMEDISK_STATS_MEMORY_TYPE,
+                              mach_task_self(), &address, &size,
+                              kIOMapAnywhere | kIOMapReadOnly);
+    if(kr != KERN_SUCCESS) {
+        fprintf(stderr, "%s: IOConnectMapMemory64 failed (0x%x)\n",
+                argv[0], kr);
+        IOServiceClose(connect);
+        return 1;
+    }
+
+    const volatile StatsPage *page = (const volatile StatsPage*) address;
+    int result = 0;
+    if(size < sizeof(StatsPage) ||
+       page->version != RENAMEDISK_STATS_VERSION ||
+       page->size != sizeof(StatsPage)) {
+        fprintf(stderr, "%s: unsupported statistics page (version %u)\n",
+                argv[0], page->version);
+        result = 1;
+    }
+    else {
+        StatsPage copy;
+        while(count) {
+            statsSnapshot(page, &copy);
+            statsPrint(stdout, &copy);
+            if(count > 0)
+                count--;
+            if(count)
+                sleep(interval);
+        }
+    }
+
+    IOConnectUnmapMemory64(connect, RENAMEDISK_STATS_MEMORY_TYPE,
+                           mach_task_self(), address);
+    IOServiceClose(connect);
+    return result;
+}
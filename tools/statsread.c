@@ -0,0 +1,91 @@
+/*
+ * Copyright (c) 2014, baskingshark
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ *  statsread.c
+ *
+ *  Read the statistics page published by RenameDisk.kext.
+ */
+
+#include <string.h>
+#include "statsread.h"
+
+static const char *COUNTER_NAMES[kStatsCounterCount] = {
+    "Set hook calls",
+    "Rewrites",
+};
+
+static const char *PHASE_NAMES[kStatsPhaseCount] = {
+    "Probe",
+    "Stop target",
+    "Hook",
+    "Restart",
+    "Terminate",
+    "Unhook",
+    "Stop",
+};
+
+static const char *STATE_NAMES[] = {
+    "unused",
+    "restarting",
+    "running",
+    "stopped",
+};
+
+void statsSnapshot(const volatile StatsPage *page, StatsPage *copy)
+{
+    uint32_t seq;
+    do {
+        while((seq = page->sequence) & 1)
+            ;
+        __sync_synchronize();
+        memcpy(copy, (const void*) page, sizeof(*copy));
+        __sync_synchronize();
+    } while(page->sequence != seq);
+}
+
+void statsPrint(FILE *out, const StatsPage *s)
+{
+    fprintf(out, "sequence %u\n", s->sequence);
+    for(int i = 0; i < kStatsCounterCount; i++)
+        fprintf(out, "  %-16s %llu\n", COUNTER_NAMES[i],
+                (unsigned long long) s->counters[i]);
+    for(int i = 0; i < kStatsPhaseCount; i++) {
+        const StatsPhaseTimes *t = &s->phases[i];
+        fprintf(out, "  %-16s count %llu avg %llu ns max %llu ns\n",
+                PHASE_NAMES[i], (unsigned long long) t->count,
+                (unsigned long long) (t->count ? t->totalNs / t->count : 0),
+                (unsigned long long) t->maxNs);
+    }
+    for(uint32_t i = 0;
+        i < s->diskCount && i < RENAMEDISK_STATS_MAX_DISKS;
+        i++) {
+        const StatsDisk *d = &s->disks[i];
+        fprintf(out, "  disk %-20.*s %-10s restarts %u\n",
+                RENAMEDISK_STATS_SERIAL_LEN, d->serial,
+                d->state <= kStatsDiskStopped ? STATE_NAMES[d->state] : "?",
+                d->restarts);
+    }
+}
@@ -0,0 +1,116 @@
+/*
+ * Copyright (c) 2014, baskingshark
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ *  chain_bench.cpp
+ *
+ *  Measure the cost of invoking a hook chain against its length.
+ *
+ *  Chains of 1 to MAX_LENGTH callbacks are built from rewriters that keep
+ *  the value, as most hooks do for a value they have nothing to change,
+ *  and from observers.  The fastest of several runs is reported, and the
+ *  benchmark fails if a callback costs more than CALLBACK_BUDGET_NS.
+ */
+
+#include <stdio.h>
+#include "objects.h"
+
+static const unsigned int MAX_LENGTH = 64;
+
+// Invokes per run are scaled so that each run makes this many callbacks
+static const unsigned long CALLBACKS_PER_RUN = 4000000;
+
+static const int RUNS = 5;
+
+// Budget for one callback, including the call through the array.  A walk
+// over a contiguous array takes a few ns per callback.
+static const double CALLBACK_BUDGET_NS = 25;
+
+static Object targets[MAX_LENGTH];
+static Object value = { 1000, 1 };
+
+static const Object *keep(const Object *, int, const Object *v)
+{
+    if(v)
+        ObjectTraits::retain(v);
+    return v;
+}
+
+static void watch(const Object *, int, const Object *)
+{
+}
+
+/*
+ * Time invokes of a chain of n callbacks, in ns per invoke.
+ */
+static double measure(bool observers, unsigned int n)
+{
+    ObjectChain chain;
+    for(unsigned int i = 0; i < n; i++)
+        if(!chain.add(observers ? NULL : keep, observers ? watch : NULL,
+                      &targets[i], i % 4, false))
+            fail("add failed");
+
+    unsigned long invokes = CALLBACKS_PER_RUN / n;
+    uint64_t best = UINT64_MAX;
+    for(int run = 0; run < RUNS; run++) {
+        uint64_t start = nowNs();
+        for(unsigned long i = 0; i < invokes; i++) {
+            const Object *result = chain.invoke(0, &value);
+            ObjectTraits::release(result);
+        }
+        uint64_t ns = nowNs() - start;
+        if(ns < best)
+            best = ns;
+    }
+    return (double) best / invokes;
+}
+
+int main()
+{
+    for(unsigned int i = 0; i < MAX_LENGTH; i++) {
+        targets[i].id = i;
+        targets[i].refs = 1;
+    }
+
+    int result = 0;
+    printf("%-10s %8s %12s %12s\n", "kind", "length", "ns/invoke",
+           "ns/callback");
+    for(int kind = 0; kind < 2; kind++) {
+        for(unsigned int n = 1; n <= MAX_LENGTH; n *= 2) {
+            double ns = measure(kind == 1, n);
+            printf("%-10s %8u %12.1f %12.2f\n",
+                   kind ? "observers" : "rewriters", n, ns, ns / n);
+            if(ns / n > CALLBACK_BUDGET_NS) {
+                fprintf(stderr, "FAILED: %.2f ns per callback, "
+                        "budget is %.0f ns\n", ns / n, CALLBACK_BUDGET_NS);
+                result = 1;
+            }
+        }
+    }
+    checkBalanced(targets, MAX_LENGTH);
+    checkBalanced(&value, 1);
+    return result;
+}
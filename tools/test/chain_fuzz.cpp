@@ -0,0 +1,246 @@
+/*
+ * Copyright (c) 2014, baskingshark
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ *  chain_fuzz.cpp
+ *
+ *  Fuzz target for the hook chains used by Dictionary.
+ *
+ *  The input is read as a sequence of operations on a CallbackChain: add a
+ *  rewriter or an observer, remove one, or invoke the chain.  The chain is
+ *  checked against a reference model after each operation.  Each invoke
+ *  must run the callbacks in the same order as the model and stop at the
+ *  same final rewriter, within a time budget and without allocating.
+ *  Once the chain is freed, every object must be back to the reference
+ *  held by the test.
+ */
+
+#include <algorithm>
+#include <vector>
+#include "objects.h"
+
+static const int TARGETS = 4;
+static const int VALUES = TARGETS;
+
+// Longest chain built, also the longest invoke held to the budget
+static const unsigned int MAX_ENTRIES = 64;
+
+// Budgets for one operation on a chain of up to MAX_ENTRIES callbacks.  add
+// may have to grow the array.
+static const uint64_t ADD_BUDGET_NS = 20000;
+static const uint64_t INVOKE_BUDGET_NS = 20000;
+
+static Object targets[TARGETS];
+static Object values[VALUES];
+
+// Callbacks run by the last invoke, as callback and target ids
+static int traceFn[MAX_ENTRIES];
+static int traceTarget[MAX_ENTRIES];
+static unsigned int traceLen;
+
+static void record(int fn, const Object *target)
+{
+    if(traceLen == MAX_ENTRIES)
+        fail("more callbacks run than are in the chain");
+    traceFn[traceLen] = fn;
+    traceTarget[traceLen] = target->id;
+    traceLen++;
+}
+
+/*
+ * Callbacks, identified by their index in CALLBACKS.  The rewriters keep
+ * the value, replace it with the value of their target or drop it.
+ */
+enum { kKeep, kReplace, kDrop, kWatch, kWatchToo, kCallbackCount };
+
+static const Object *keep(const Object *target, int, const Object *value)
+{
+    record(kKeep, target);
+    if(value)
+        ObjectTraits::retain(value);
+    return value;
+}
+
+static const Object *replace(const Object *target, int, const Object *)
+{
+    record(kReplace, target);
+    const Object *result = &values[target->id];
+    ObjectTraits::retain(result);
+    return result;
+}
+
+static const Object *drop(const Object *target, int, const Object *)
+{
+    record(kDrop, target);
+    return NULL;
+}
+
+static void watch(const Object *target, int, const Object *)
+{
+    record(kWatch, target);
+}
+
+static void watchToo(const Object *target, int, const Object *)
+{
+    record(kWatchToo, target);
+}
+
+static const RewriteFn REWRITERS[kCallbackCount] = {
+    keep, replace, drop, NULL, NULL
+};
+static const ObserveFn OBSERVERS[kCallbackCount] = {
+    NULL, NULL, NULL, watch, watchToo
+};
+
+struct Model {
+    int          fn;
+    int          target;
+    int32_t      priority;
+    bool         final;
+    unsigned int seq;
+};
+
+static bool runsBefore(const Model &a, const Model &b)
+{
+    if(a.priority != b.priority)
+        return a.priority > b.priority;
+    return a.seq < b.seq;
+}
+
+/*
+ * Check the last invoke of the chain on value against the model.
+ */
+static void checkInvoke(const std::vector<Model> &model,
+                        const Object             *value,
+                        const Object             *result)
+{
+    std::vector<Model> order(model);
+    std::sort(order.begin(), order.end(), runsBefore);
+    unsigned int n = 0;
+    for(size_t i = 0; i < order.size(); i++) {
+        const Model &m = order[i];
+        if(n >= traceLen || traceFn[n] != m.fn || traceTarget[n] != m.target)
+            fail("callback %u should be %d on target %d", n, m.fn, m.target);
+        n++;
+        if(m.fn >= kWatch)
+            continue;
+        const Object *next = m.fn == kKeep ? value :
+                             m.fn == kReplace ? &values[m.target] : NULL;
+        bool changed = next != value;
+        value = next;
+        if(changed && m.final)
+            break;
+    }
+    if(n != traceLen)
+        fail("%u callbacks run, expected %u", traceLen, n);
+    if(result != value)
+        fail("invoke returned %d, expected %d",
+             result ? result->id : -1, value ? value->id : -1);
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+    for(int i = 0; i < TARGETS; i++) {
+        targets[i].id = i;
+        targets[i].refs = 1;
+        values[i].id = 100 + i;
+        values[i].refs = 1;
+    }
+
+    size_t pos = 0;
+    unsigned int seq = 0;
+    std::vector<Model> model;
+    model.reserve(MAX_ENTRIES);
+    {
+        ObjectChain chain;
+        while(pos < size) {
+            int op = data[pos++] % 4;
+            uint8_t args[4] = { 0, 0, 0, 0 };
+            for(int i = 0; i < 4 && pos < size; i++)
+                args[i] = data[pos++];
+
+            if(op <= 1) {
+                Model m;
+                m.fn = op == 0 ? args[0] % kWatch :
+                                 kWatch + args[0] % (kCallbackCount - kWatch);
+                m.target = args[1] % TARGETS;
+                m.priority = args[2] % 5 - 2;
+                m.final = m.fn < kWatch && (args[3] & 1);
+                m.seq = ++seq;
+                std::vector<Model>::iterator it = model.begin();
+                while(it != model.end() &&
+                      (it->fn != m.fn || it->target != m.target))
+                    ++it;
+                if(it != model.end())
+                    model.erase(it);
+                else if(model.size() == MAX_ENTRIES)
+                    continue;
+                bool added = false;
+                // Adding again only moves the entry, so repeating is fine
+                withinBudget("add", ADD_BUDGET_NS, 1, [&] {
+                    added = chain.add(REWRITERS[m.fn], OBSERVERS[m.fn],
+                                      &targets[m.target], m.priority,
+                                      m.final);
+                });
+                if(!added)
+                    fail("add failed");
+                model.push_back(m);
+            }
+            else if(op == 2) {
+                if(model.empty()) {
+                    if(chain.remove(keep, NULL, &targets[0]))
+                        fail("removed a callback from an empty chain");
+                    continue;
+                }
+                size_t i = args[0] % model.size();
+                const Model &m = model[i];
+                if(!chain.remove(REWRITERS[m.fn], OBSERVERS[m.fn],
+                                 &targets[m.target]))
+                    fail("callback %d on target %d not found",
+                         m.fn, m.target);
+                model.erase(model.begin() + i);
+            }
+            else {
+                const Object *value =
+                    args[0] % (VALUES + 1) < VALUES ?
+                    &values[args[0] % (VALUES + 1)] : NULL;
+                const Object *result = NULL;
+                withinBudget("invoke", INVOKE_BUDGET_NS, 0, [&] {
+                    traceLen = 0;
+                    result = chain.invoke(0, value);
+                    if(result)
+                        ObjectTraits::release(result);
+                });
+                checkInvoke(model, value, result);
+            }
+            if(chain.getCount() != model.size())
+                fail("chain has %u callbacks, expected %zu",
+                     chain.getCount(), model.size());
+        }
+    }
+    checkBalanced(targets, TARGETS);
+    checkBalanced(values, VALUES);
+    return 0;
+}
@@ -0,0 +1,179 @@
+/*
+ * Copyright (c) 2014, baskingshark
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ *  decision_test.cpp
+ *
+ *  Check the decision table lookup of the kext on the host.
+ *
+ *  lookupDecision runs on tables built in ordinary memory the same way the kext
+ *  runs it on the decision table of its personality.  Each case looks up a
+ *  Model and Revision and checks the result against the expected decision.
+ */
+
+#include <map>
+#include <string>
+#include "../../RenameDisk/Decision.h"
+#include "harness.h"
+
+/*
+ * An entry of a host decision table: a string, a table or neither, the way
+ * a personality entry may be an OSString, an OSDictionary or anything else.
+ */
+struct Node {
+    enum Kind { kString, kTable, kOther } kind;
+    std::string                 str;
+    std::map<std::string, Node> table;
+
+    Node() : kind(kTable) {}
+    Node(const char *s) : kind(kString), str(s) {}
+    static Node other()
+    {
+        Node n;
+        n.kind = kOther;
+        return n;
+    }
+};
+
+struct NodeTraits {
+    typedef const Node *Table;
+    typedef const char *Key;
+    typedef const Node *Value;
+
+    static Value get(Table table, Key key)
+    {
+        std::map<std::string, Node>::const_iterator it = table->table.find(key);
+        return it == table->table.end() ? NULL : &it->second;
+    }
+    static Value getAny(Table table)
+    {
+        return get(table, DECISION_ANY_REVISION);
+    }
+    static Table asTable(Value value)
+    {
+        return value->kind == Node::kTable ? value : NULL;
+    }
+    static const char *asString(Value value)
+    {
+        return value->kind == Node::kString ? value->str.c_str() : NULL;
+    }
+};
+
+static void expect(const Node &table, const char *model, const char *revision,
+                   Decision expected)
+{
+    Decision d = lookupDecision<NodeTraits>(&table, model, revision);
+    if(d != expected)
+        fail("'%s' (%s): decision %d, expected %d", model,
+             revision ? revision : "NULL", d, expected);
+}
+
+static void testParse()
+{
+    static const struct {
+        const char *value;
+        Decision    expected;
+    } cases[] = {
+        { "rewrite",  kDecisionRewrite },
+        { "skip",     kDecisionSkip },
+        { "ignore",   kDecisionIgnore },
+        { NULL,       kDecisionUnknown },
+        { "",         kDecisionUnknown },
+        { "Rewrite",  kDecisionUnknown },
+        { "rewrites", kDecisionUnknown },
+        { "skip ",    kDecisionUnknown },
+        { "*",        kDecisionUnknown },
+    };
+    for(size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++)
+        if(parseDecision(cases[i].value) != cases[i].expected)
+            fail("parseDecision('%s') is %d, expected %d",
+                 cases[i].value ? cases[i].value : "NULL",
+                 parseDecision(cases[i].value), cases[i].expected);
+}
+
+static void testLookup()
+{
+    Node table;
+    table.table["Plain SSD"] = "rewrite";
+    table.table["APPLE SSD SM256"] = "skip";
+    table.table["Optical"] = "ignore";
+    table.table["Misspelt"] = "rewrote";
+    table.table["Number"] = Node::other();
+
+    Node &revisions = table.table["Some SSD"];
+    revisions.table["1.0"] = "skip";
+    revisions.table["2.0"] = "ignore";
+    revisions.table["3.0"] = Node::other();
+    revisions.table["4.0"] = Node();
+    revisions.table[DECISION_ANY_REVISION] = "rewrite";
+
+    Node &listed = table.table["Other SSD"];
+    listed.table["1.0"] = "rewrite";
+
+    table.table[DECISION_ANY_REVISION] = "rewrite";
+
+    // Plain entries apply to any revision
+    expect(table, "Plain SSD", "1.0", kDecisionRewrite);
+    expect(table, "Plain SSD", NULL, kDecisionRewrite);
+    expect(table, "APPLE SSD SM256", "1.0", kDecisionSkip);
+    expect(table, "Optical", NULL, kDecisionIgnore);
+
+    // Anything that is not a decision is unknown
+    expect(table, "Misspelt", "1.0", kDecisionUnknown);
+    expect(table, "Number", "1.0", kDecisionUnknown);
+
+    // Models are matched exactly, and "*" only applies to revisions
+    expect(table, "Unlisted SSD", "1.0", kDecisionUnknown);
+    expect(table, "Plain SSD ", "1.0", kDecisionUnknown);
+    expect(table, "plain ssd", "1.0", kDecisionUnknown);
+    expect(table, "", NULL, kDecisionUnknown);
+
+    // Listed revisions, then "*" for any other
+    expect(table, "Some SSD", "1.0", kDecisionSkip);
+    expect(table, "Some SSD", "2.0", kDecisionIgnore);
+    expect(table, "Some SSD", "9.9", kDecisionRewrite);
+    expect(table, "Some SSD", NULL, kDecisionRewrite);
+    expect(table, "Some SSD", DECISION_ANY_REVISION, kDecisionRewrite);
+
+    // A listed revision that is not a decision does not fall back to "*"
+    expect(table, "Some SSD", "3.0", kDecisionUnknown);
+    expect(table, "Some SSD", "4.0", kDecisionUnknown);
+
+    // Without "*", other revisions are unknown
+    expect(table, "Other SSD", "1.0", kDecisionRewrite);
+    expect(table, "Other SSD", "2.0", kDecisionUnknown);
+    expect(table, "Other SSD", NULL, kDecisionUnknown);
+
+    Node empty;
+    expect(empty, "Plain SSD", "1.0", kDecisionUnknown);
+}
+
+int main()
+{
+    testParse();
+    testLookup();
+    printf("decision lookup ok\n");
+    return 0;
+}
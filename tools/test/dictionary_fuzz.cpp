@@ -0,0 +1,423 @@
+/*
+ * Copyright (c) 2014, baskingshark
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ *  dictionary_fuzz.cpp
+ *
+ *  Fuzz target for Dictionary and the fixModel hook, built against the shim.
+ *
+ *  The input is read as a sequence of operations on a Dictionary: set or
+ *  remove a value, add or remove hooks and observers, enable or disable the
+ *  hooks, set the driver that disabled them, or read the values back.  The
+ *  hooks include fixModelWith for a declared and a run-time prefix, and the
+ *  values include Models around and beyond MAX_MODEL_LENGTH.
+ *
+ *  After each operation, the bytes accounted for rewritten values must match
+ *  the values the Dictionary holds, and chains of a single callback must give
+ *  the value the callback would.  Sets and reads have a time and allocation
+ *  budget.  Once the Dictionary is released, every object and every byte of
+ *  accounted memory must be freed.
+ */
+
+#include <vector>
+#include "shim/shim.h"
+#include "../../RenameDisk/Dictionary.h"
+#include "../../RenameDisk/FixModel.h"
+#include "../../RenameDisk/MemStats.h"
+#include "harness.h"
+
+DECLARE_PREFIX(FixedPrefix, "APPLE SSD");
+
+static const char *RUNTIME_PREFIX = "RD";
+
+static const int KEYS = 3;
+static const int TARGETS = 2;
+
+// Longest value set, longer than MAX_MODEL_LENGTH
+static const size_t MAX_VALUE = 510;
+
+// Budgets for a set running a chain of up to a few dozen callbacks, and for
+// reading every key back.  A set may grow both tables, and each rewriter in
+// the chain may make a value of up to two allocations.
+static const uint64_t SET_BUDGET_NS = 50000;
+static const unsigned SET_TABLE_ALLOCS = 2;
+static const unsigned REWRITER_ALLOCS = 2;
+// An add may make the chain and grow the hook table
+static const uint64_t ADD_BUDGET_NS = 50000;
+static const uint64_t GET_BUDGET_NS = 10000;
+
+static const char *KEY_NAMES[KEYS] = { "Model", "Revision", "Other" };
+
+/*
+ * Callbacks, identified by their index in CALLBACKS.  The rewriters either
+ * run fixModelWith, keep the value, drop it or replace it with a number.
+ */
+enum {
+    kFixFixed, kFixRuntime, kKeep, kDrop, kNumber,
+    kWatch, kWatchToo, kCallbackCount
+};
+
+static const OSMetaClassBase *fixFixed(const OSObject        *target,
+                                       const OSSymbol        *aKey,
+                                       const OSMetaClassBase *anObject)
+{
+    return fixModelWith(FixedPrefix(), target, aKey, anObject);
+}
+
+static const OSMetaClassBase *fixRuntime(const OSObject        *target,
+                                         const OSSymbol        *aKey,
+                                         const OSMetaClassBase *anObject)
+{
+    return fixModelWith(RuntimePrefix(RUNTIME_PREFIX, strlen(RUNTIME_PREFIX)),
+                        target, aKey, anObject);
+}
+
+static const OSMetaClassBase *keep(const OSObject        *target,
+                                   const OSSymbol        *aKey,
+                                   const OSMetaClassBase *anObject)
+{
+    if(anObject)
+        anObject->retain();
+    return anObject;
+}
+
+static const OSMetaClassBase *drop(const OSObject        *target,
+                                   const OSSymbol        *aKey,
+                                   const OSMetaClassBase *anObject)
+{
+    return NULL;
+}
+
+static const OSMetaClassBase *number(const OSObject        *target,
+                                     const OSSymbol        *aKey,
+                                     const OSMetaClassBase *anObject)
+{
+    return OSNumber::withNumber(42, 32);
+}
+
+static void watch(const OSObject        *target,
+                  const OSSymbol        *aKey,
+                  const OSMetaClassBase *anObject)
+{
+    // The value must still be alive
+    if(anObject)
+        anObject->getMetaClass();
+}
+
+static void watchToo(const OSObject        *target,
+                     const OSSymbol        *aKey,
+                     const OSMetaClassBase *anObject)
+{
+    watch(target, aKey, anObject);
+}
+
+static const Dictionary::SetCallback REWRITERS[kCallbackCount] = {
+    fixFixed, fixRuntime, keep, drop, number, NULL, NULL
+};
+static const Dictionary::ObserveCallback OBSERVERS[kCallbackCount] = {
+    NULL, NULL, NULL, NULL, NULL, watch, watchToo
+};
+
+struct Entry {
+    int fn;
+    int target;
+};
+
+/*
+ * Make the value for a set from the operation arguments: a short Model, one
+ * that already has the prefix, one around MAX_MODEL_LENGTH, a longer one, a
+ * number or nothing.  The result is retained.
+ */
+static OSObject *makeValue(const uint8_t *args)
+{
+    char buffer[MAX_VALUE + 1];
+    size_t len;
+    size_t start = 0;
+    switch(args[0] % 6) {
+    case 0:
+        len = args[1] % 16;
+        break;
+    case 1:
+        start = strlen(FixedPrefix().text());
+        memcpy(buffer, FixedPrefix().text(), start);
+        len = start + args[1] % 16;
+        break;
+    case 2:
+        len = MAX_MODEL_LENGTH - 2 + args[1] % 5;
+        break;
+    case 3:
+        len = args[1] * 2;
+        break;
+    case 4:
+        return OSNumber::withNumber(args[1], 8);
+    default:
+        return NULL;
+    }
+    for(size_t i = start; i < len; i++)
+        buffer[i] = 'A' + (args[2] + i) % 26;
+    buffer[len] = '\0';
+    return OSString::withCString(buffer);
+}
+
+/*
+ * Read the current bytes of a category through memCopyStats.
+ */
+static uint64_t currentBytes(const char *category)
+{
+    OSDictionary *stats = memCopyStats();
+    if(!stats)
+        fail("memCopyStats failed");
+    OSDictionary *entry =
+        OSDynamicCast(OSDictionary, stats->getObject(category));
+    OSNumber *num = entry ?
+        OSDynamicCast(OSNumber, entry->getObject("Current Bytes")) : NULL;
+    if(!num)
+        fail("no current bytes for '%s' in memory statistics", category);
+    uint64_t result = num->unsigned64BitValue();
+    stats->release();
+    return result;
+}
+
+/*
+ * Check a set against what a chain of at most one rewriter would give.
+ * Longer chains are left to the reference counting and accounting checks.
+ */
+static void checkSet(const std::vector<Entry> &chain,
+                     bool                      enabled,
+                     const OSObject           *value,
+                     const OSMetaClassBase    *before,
+                     const OSMetaClassBase    *stored,
+                     bool                      result,
+                     uint64_t                  rewrites)
+{
+    int fn = kKeep;
+    for(size_t i = 0; enabled && i < chain.size(); i++) {
+        if(chain[i].fn < kWatch) {
+            if(fn != kKeep)
+                return;
+            fn = chain[i].fn;
+        }
+    }
+
+    if(fn == kDrop || (!value && fn != kNumber)) {
+        if(result || stored != before)
+            fail("set of NULL replaced the value");
+        return;
+    }
+    if(!result)
+        fail("set failed");
+    if(fn == kKeep) {
+        if(stored != value)
+            fail("value changed without a rewriter");
+        return;
+    }
+    if(fn == kNumber) {
+        if(stored == value || !OSDynamicCast(OSNumber, stored))
+            fail("value not replaced by a number");
+        return;
+    }
+
+    // fixModelWith
+    const OSString *str = OSDynamicCast(OSString, value);
+    const char *prefix = fn == kFixFixed ? FixedPrefix().text() :
+                                           RUNTIME_PREFIX;
+    const size_t plen = strlen(prefix);
+    if(!str || str->getLength() > MAX_MODEL_LENGTH ||
+       !strncmp(str->getCStringNoCopy(), prefix, plen)) {
+        if(stored != value || rewrites)
+            fail("Model rewritten without need");
+        return;
+    }
+    char expected[MAX_REWRITE_LENGTH];
+    snprintf(expected, sizeof(expected), "%s (%s)",
+             prefix, str->getCStringNoCopy());
+    const OSString *got = OSDynamicCast(OSString, stored);
+    if(!got || strcmp(got->getCStringNoCopy(), expected))
+        fail("Model '%s' not rewritten to '%s'",
+             str->getCStringNoCopy(), expected);
+    if(rewrites != BUDGET_RUNS)
+        fail("%llu rewrites counted for %d sets",
+             (unsigned long long) rewrites, BUDGET_RUNS);
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+    const int live = shimLiveObjects();
+    const OSSymbol *keys[KEYS];
+    for(int i = 0; i < KEYS; i++)
+        keys[i] = OSSymbol::withCString(KEY_NAMES[i]);
+    OSObject *targets[TARGETS];
+    for(int i = 0; i < TARGETS; i++)
+        targets[i] = OSTypeAlloc(OSObject);
+
+    OSDictionary *props = OSDictionary::withCapacity(1);
+    OSString *initial = OSString::withCString("INITIAL MODEL");
+    props->setObject(keys[0], initial);
+    initial->release();
+    Dictionary *dict = Dictionary::withDictionary(props);
+    props->release();
+    if(!dict)
+        fail("Dictionary::withDictionary failed");
+
+    std::vector<Entry> chains[KEYS];
+    bool rewritten[KEYS] = { false, false, false };
+    bool enabled = true;
+    OSObject *disabler = NULL;
+
+    size_t pos = 0;
+    while(pos < size) {
+        int op = data[pos++] % 9;
+        uint8_t args[4] = { 0, 0, 0, 0 };
+        for(int i = 0; i < 4 && pos < size; i++)
+            args[i] = data[pos++];
+        const int k = args[3] % KEYS;
+        const OSSymbol *key = keys[k];
+
+        if(op <= 1) {
+            OSObject *value = makeValue(args);
+            const OSMetaClassBase *before = dict->getObject(key);
+            if(before)
+                before->retain();
+            const uint64_t rewrites = shimStatsCounter(kStatsRewrites);
+            unsigned allocs = SET_TABLE_ALLOCS;
+            for(size_t i = 0; enabled && i < chains[k].size(); i++)
+                if(REWRITERS[chains[k][i].fn])
+                    allocs += REWRITER_ALLOCS;
+            bool result = false;
+            // Setting the same value again gives the same result
+            withinBudget("setObject", SET_BUDGET_NS, allocs, [&] {
+                result = dict->setObject(key, value);
+            });
+            const OSMetaClassBase *stored = dict->getObject(key);
+            if(result)
+                rewritten[k] = stored != value;
+            checkSet(chains[k], enabled, value, before, stored, result,
+                     shimStatsCounter(kStatsRewrites) - rewrites);
+            OSSafeRelease(before);
+            OSSafeRelease(value);
+        }
+        else if(op == 2) {
+            dict->removeObject(key);
+            if(dict->getObject(key))
+                fail("value not removed");
+            rewritten[k] = false;
+        }
+        else if(op == 3) {
+            Entry e;
+            e.fn = args[0] % kCallbackCount;
+            e.target = args[1] % TARGETS;
+            const SInt32 priority = args[2] % 5 - 2;
+            bool added = false;
+            // Adding again only moves the entry, so repeating is fine
+            withinBudget("addHook", ADD_BUDGET_NS, 3, [&] {
+                if(REWRITERS[e.fn])
+                    added = dict->addHook(key, targets[e.target],
+                                          REWRITERS[e.fn], priority,
+                                          args[2] & 0x80 ?
+                                          Dictionary::kHookFinal : 0);
+                else
+                    added = dict->addObserver(key, targets[e.target],
+                                              OBSERVERS[e.fn], priority);
+            });
+            if(!added)
+                fail("adding callback %d failed", e.fn);
+            std::vector<Entry> &chain = chains[k];
+            for(size_t i = 0; i < chain.size(); i++) {
+                if(chain[i].fn == e.fn && chain[i].target == e.target) {
+                    chain.erase(chain.begin() + i);
+                    break;
+                }
+            }
+            chain.push_back(e);
+        }
+        else if(op == 4) {
+            dict->removeHook(key);
+            chains[k].clear();
+        }
+        else if(op == 5) {
+            std::vector<Entry> &chain = chains[k];
+            Entry e;
+            e.fn = args[0] % kCallbackCount;
+            e.target = args[1] % TARGETS;
+            if(!chain.empty() && (args[2] & 1))
+                e = chain[args[2] % chain.size()];
+            size_t i = 0;
+            while(i < chain.size() &&
+                  (chain[i].fn != e.fn || chain[i].target != e.target))
+                i++;
+            bool removed = REWRITERS[e.fn] ?
+                dict->removeHook(key, targets[e.target], REWRITERS[e.fn]) :
+                dict->removeObserver(key, targets[e.target], OBSERVERS[e.fn]);
+            if(removed != (i < chain.size()))
+                fail("removing callback %d on target %d returned %d",
+                     e.fn, e.target, removed);
+            if(removed)
+                chain.erase(chain.begin() + i);
+        }
+        else if(op == 6) {
+            enabled = args[0] & 1;
+            dict->setHooksEnabled(enabled);
+            if(dict->getHooksEnabled() != enabled)
+                fail("hooks not %s", enabled ? "enabled" : "disabled");
+        }
+        else if(op == 7) {
+            disabler = args[0] % (TARGETS + 1) < TARGETS ?
+                       targets[args[0] % (TARGETS + 1)] : NULL;
+            dict->setDisabledBy(disabler);
+            if(dict->getDisabledBy() != disabler)
+                fail("disabling driver not recorded");
+        }
+        else {
+            withinBudget("getObject", GET_BUDGET_NS, 0, [&] {
+                for(int i = 0; i < KEYS; i++)
+                    dict->getObject(keys[i]);
+            });
+        }
+
+        uint64_t expected = 0;
+        for(int i = 0; i < KEYS; i++)
+            if(rewritten[i])
+                expected += memSizeOf(dict->getObject(keys[i]));
+        if(currentBytes("Rewritten Values") != expected)
+            fail("%llu bytes of rewritten values accounted, %llu held",
+                 (unsigned long long) currentBytes("Rewritten Values"),
+                 (unsigned long long) expected);
+    }
+
+    dict->release();
+    static const char *CATEGORIES[] = {
+        "Dictionary", "Hook Tables", "Hook Chains", "Rewritten Values"
+    };
+    for(size_t i = 0; i < sizeof(CATEGORIES) / sizeof(CATEGORIES[0]); i++)
+        if(currentBytes(CATEGORIES[i]))
+            fail("'%s' still accounted after free", CATEGORIES[i]);
+    for(int i = 0; i < TARGETS; i++)
+        targets[i]->release();
+    for(int i = 0; i < KEYS; i++)
+        keys[i]->release();
+    if(shimLiveObjects() != live)
+        fail("%d objects leaked", shimLiveObjects() - live);
+    return 0;
+}
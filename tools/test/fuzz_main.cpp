@@ -0,0 +1,104 @@
+/*
+ * Copyright (c) 2014, baskingshark
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ *  fuzz_main.cpp
+ *
+ *  Standalone driver for the fuzz targets, used where libFuzzer is not
+ *  available.
+ *
+ *  With file arguments, each file is run through the target once, e.g. to
+ *  replay a crash found by libFuzzer.  Otherwise random inputs are
+ *  generated from a fixed seed, half of them from a two letter alphabet so
+ *  that prefixes and repeated keys are common.
+ *
+ *      usage: target [-n iterations] [-s seed] [file ...]
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <vector>
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size);
+
+// Longest input generated
+static const size_t MAX_INPUT = 256;
+
+static int runFile(const char *path)
+{
+    FILE *f = fopen(path, "rb");
+    if(!f) {
+        perror(path);
+        return 1;
+    }
+    std::vector<uint8_t> data;
+    int c;
+    while((c = fgetc(f)) != EOF)
+        data.push_back((uint8_t) c);
+    fclose(f);
+    LLVMFuzzerTestOneInput(data.data(), data.size());
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned long iterations = 100000;
+    unsigned seed = 1;
+    int ch;
+    while((ch = getopt(argc, argv, "n:s:")) != -1) {
+        switch(ch) {
+        case 'n':
+            iterations = strtoul(optarg, NULL, 10);
+            break;
+        case 's':
+            seed = (unsigned) strtoul(optarg, NULL, 10);
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-n iterations] [-s seed] [file ...]\n",
+                    argv[0]);
+            return 1;
+        }
+    }
+    if(optind < argc) {
+        int result = 0;
+        for(int i = optind; i < argc; i++)
+            result |= runFile(argv[i]);
+        return result;
+    }
+
+    srand(seed);
+    uint8_t data[MAX_INPUT];
+    for(unsigned long i = 0; i < iterations; i++) {
+        size_t size = rand() % (MAX_INPUT + 1);
+        bool narrow = rand() & 1;
+        for(size_t j = 0; j < size; j++)
+            data[j] = narrow ? "AB"[rand() & 1] : (uint8_t) rand();
+        LLVMFuzzerTestOneInput(data, size);
+    }
+    printf("%lu inputs\n", iterations);
+    return 0;
+}
@@ -0,0 +1,127 @@
+/*
+ * Copyright (c) 2014, baskingshark
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ *  harness.h
+ *
+ *  Failure reporting and per-operation budgets for the host tests.
+ *
+ *  Allocations are counted through the sanitizer malloc hooks, so the tests
+ *  using budgets must be built with AddressSanitizer, as both the libFuzzer
+ *  and the standalone builds are.  A failed check aborts, which libFuzzer
+ *  reports as a crash and saves the input that caused it.
+ */
+
+#ifndef __harness__
+#define __harness__
+
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+extern "C" int __sanitizer_install_malloc_and_free_hooks(
+    void (*mallocHook)(const volatile void *ptr, size_t size),
+    void (*freeHook)(const volatile void *ptr));
+
+// Runs of an operation, the fastest of which is held to its time budget.
+// Taking the fastest keeps preemption and page faults from failing a run.
+static const int BUDGET_RUNS = 3;
+
+static volatile unsigned long allocations;
+
+// Set once the hooks are installed, installing them again would count each
+// allocation twice
+static bool hooked;
+
+static inline void countMalloc(const volatile void *ptr, size_t size)
+{
+    (void) ptr;
+    (void) size;
+    allocations++;
+}
+
+static inline void countFree(const volatile void *ptr)
+{
+    (void) ptr;
+}
+
+/*
+ * Report a failed check and abort.
+ */
+__attribute__((noreturn, format(printf, 1, 2)))
+static inline void fail(const char *fmt, ...)
+{
+    va_list ap;
+    va_start(ap, fmt);
+    fputs("FAILED: ", stderr);
+    vfprintf(stderr, fmt, ap);
+    fputc('\n', stderr);
+    va_end(ap);
+    abort();
+}
+
+static inline uint64_t nowNs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/*
+ * Run op and fail if it takes longer than maxNs or allocates more than
+ * maxAllocs times.  op is run several times, so it must be repeatable.
+ */
+template<class Op>
+static void withinBudget(const char *name,
+                         uint64_t    maxNs,
+                         unsigned    maxAllocs,
+                         const Op   &op)
+{
+    if(!hooked) {
+        if(!__sanitizer_install_malloc_and_free_hooks(countMalloc, countFree))
+            fail("cannot install malloc hooks");
+        hooked = true;
+    }
+    uint64_t best = UINT64_MAX;
+    for(int i = 0; i < BUDGET_RUNS; i++) {
+        unsigned long before = allocations;
+        uint64_t start = nowNs();
+        op();
+        uint64_t ns = nowNs() - start;
+        unsigned long made = allocations - before;
+        if(made > maxAllocs)
+            fail("%s made %lu allocations, budget is %u",
+                 name, made, maxAllocs);
+        if(ns < best)
+            best = ns;
+    }
+    if(best > maxNs)
+        fail("%s took %llu ns, budget is %llu ns", name,
+             (unsigned long long) best, (unsigned long long) maxNs);
+}
+
+#endif /* defined(__harness__) */
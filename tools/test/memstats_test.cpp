@@ -0,0 +1,299 @@
+/*
+ * Copyright (c) 2014, baskingshark
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ *  memstats_test.cpp
+ *
+ *  Check the memory accounting of the kext on the host.
+ *
+ *  MemStats is driven directly through alloc, free, track and resize
+ *  sequences, then through a Dictionary hooking a key the way fixModel does.
+ *  Each step checks the current and peak bytes and the allocation and free
+ *  counts as published by memCopyStats.  Once everything is released, every
+ *  category must be back to zero with as many frees as allocations.
+ */
+
+#include "shim/shim.h"
+#include "../../RenameDisk/Dictionary.h"
+#include "../../RenameDisk/MemStats.h"
+#include "harness.h"
+
+// Published names, in MemCategory order
+static const char *CATEGORIES[kMemCategoryCount] = {
+    "Dictionary",
+    "Hook Tables",
+    "Hook Chains",
+    "Rewritten Values",
+};
+
+struct Counts {
+    uint64_t current;
+    uint64_t peak;
+    uint64_t allocs;
+    uint64_t frees;
+};
+
+static uint64_t getNumber(OSDictionary *entry, const char *key)
+{
+    OSNumber *num = OSDynamicCast(OSNumber, entry->getObject(key));
+    if(!num)
+        fail("no '%s' in memory statistics", key);
+    return num->unsigned64BitValue();
+}
+
+/*
+ * Read the counts of a category through memCopyStats.
+ */
+static Counts getCounts(MemCategory category)
+{
+    OSDictionary *stats = memCopyStats();
+    if(!stats)
+        fail("memCopyStats failed");
+    OSDictionary *entry =
+        OSDynamicCast(OSDictionary, stats->getObject(CATEGORIES[category]));
+    if(!entry)
+        fail("no '%s' in memory statistics", CATEGORIES[category]);
+    Counts result;
+    result.current = getNumber(entry, "Current Bytes");
+    result.peak = getNumber(entry, "Peak Bytes");
+    result.allocs = getNumber(entry, "Allocations");
+    result.frees = getNumber(entry, "Frees");
+    stats->release();
+    return result;
+}
+
+static void expect(const char *step,
+                   MemCategory category,
+                   uint64_t    current,
+                   uint64_t    peak,
+                   uint64_t    allocs,
+                   uint64_t    frees)
+{
+    Counts c = getCounts(category);
+    if(c.current != current || c.peak != peak ||
+       c.allocs != allocs || c.frees != frees)
+        fail("%s: '%s' is current %llu peak %llu allocs %llu frees %llu, "
+             "expected %llu %llu %llu %llu", step, CATEGORIES[category],
+             (unsigned long long) c.current, (unsigned long long) c.peak,
+             (unsigned long long) c.allocs, (unsigned long long) c.frees,
+             (unsigned long long) current, (unsigned long long) peak,
+             (unsigned long long) allocs, (unsigned long long) frees);
+}
+
+/*
+ * Check the counters themselves, on a category nothing else uses here.
+ */
+static void testCounters()
+{
+    const MemCategory cat = kMemHookChain;
+    expect("start", cat, 0, 0, 0, 0);
+
+    void *a = memAlloc(cat, 100);
+    void *b = memAlloc(cat, 50);
+    if(!a || !b)
+        fail("memAlloc failed");
+    expect("two allocations", cat, 150, 150, 2, 0);
+    memFree(cat, a, 100);
+    expect("free", cat, 50, 150, 2, 1);
+    memFree(cat, NULL, 100);
+    expect("free of NULL", cat, 50, 150, 2, 1);
+
+    memTrack(cat, 40);
+    expect("track", cat, 90, 150, 3, 1);
+    memResize(cat, 40, 200);
+    expect("grow", cat, 250, 250, 3, 1);
+    memResize(cat, 200, 200);
+    expect("same size", cat, 250, 250, 3, 1);
+    memResize(cat, 200, 10);
+    expect("shrink", cat, 60, 250, 3, 1);
+    memUntrack(cat, 10);
+    memFree(cat, b, 50);
+    expect("end", cat, 0, 250, 3, 3);
+
+    OSString *str = OSString::withCString("1234567");
+    if(memSizeOf(str) != OSString::gMetaClass.getClassSize() + 8)
+        fail("memSizeOf(OSString) is %zu", (size_t) memSizeOf(str));
+    str->release();
+    if(memSizeOf(NULL))
+        fail("memSizeOf(NULL) is not 0");
+}
+
+/*
+ * A set hook replacing every string with a new one, as fixModel does.
+ */
+static const OSMetaClassBase *addPrefix(const OSObject        *target,
+                                        const OSSymbol        *aKey,
+                                        const OSMetaClassBase *anObject)
+{
+    const OSString *str = OSDynamicCast(OSString, anObject);
+    if(!str) {
+        if(anObject)
+            anObject->retain();
+        return anObject;
+    }
+    char buffer[64];
+    snprintf(buffer, sizeof(buffer), "X (%s)", str->getCStringNoCopy());
+    return OSString::withCString(buffer);
+}
+
+/*
+ * An observer that does nothing.
+ */
+static void ignore(const OSObject        *target,
+                   const OSSymbol        *aKey,
+                   const OSMetaClassBase *anObject)
+{
+}
+
+/*
+ * Check the accounting of a Dictionary and the values its hook makes.
+ */
+static void testDictionary()
+{
+    const int live = shimLiveObjects();
+    OSDictionary *props = OSDictionary::withCapacity(2);
+    OSString *value = OSString::withCString("FOO");
+    const OSSymbol *model = OSSymbol::withCString("Model");
+    const OSSymbol *other = OSSymbol::withCString("Other");
+    OSObject *target = OSTypeAlloc(OSObject);
+    props->setObject(model, value);
+
+    Dictionary *dict = Dictionary::withDictionary(props);
+    if(!dict)
+        fail("Dictionary::withDictionary failed");
+    const uint64_t tableBytes = memSizeOf(dict);
+    expect("new Dictionary", kMemDictionary,
+           tableBytes, tableBytes, 1, 0);
+    Counts tables = getCounts(kMemHookTable);
+    if(tables.current == 0 || tables.allocs != 1)
+        fail("hook tables of a new Dictionary are not accounted");
+    const Counts chains = getCounts(kMemHookChain);
+
+    if(!dict->addHook(model, target, addPrefix))
+        fail("addHook failed");
+    if(getCounts(kMemHookChain).current <= chains.current)
+        fail("hook chain is not accounted");
+
+    // Setting the hooked key makes a new value, held by the Dictionary
+    dict->setObject(model, value);
+    OSObject *stored = dict->getObject(model);
+    const uint64_t first = memSizeOf(stored);
+    if(!OSDynamicCast(OSString, stored) ||
+       strcmp(static_cast<OSString*>(stored)->getCStringNoCopy(), "X (FOO)"))
+        fail("hook did not rewrite the value");
+    expect("rewritten", kMemRewritten, first, first, 1, 0);
+
+    // Setting it again replaces it
+    OSString *longer = OSString::withCString("A LONGER MODEL");
+    dict->setObject(model, longer);
+    const uint64_t second = memSizeOf(dict->getObject(model));
+    expect("rewritten again", kMemRewritten, second, second, 2, 1);
+
+    // Values set on other keys are not rewritten
+    dict->setObject(other, value);
+    expect("other key", kMemRewritten, second, second, 2, 1);
+
+    // Nor are values set while hooks are disabled, which also drops the
+    // value rewritten before
+    dict->setHooksEnabled(false);
+    dict->setObject(model, value);
+    expect("hooks disabled", kMemRewritten, 0, second, 2, 2);
+    dict->setHooksEnabled(true);
+    dict->setObject(model, value);
+    expect("hooks enabled", kMemRewritten, first, second, 3, 2);
+    dict->removeObject(model);
+    expect("removed", kMemRewritten, 0, second, 3, 3);
+    dict->setObject(model, value);
+
+    // Removing one callback keeps the others, and the chain goes with the
+    // last one
+    if(!dict->addObserver(model, target, ignore))
+        fail("addObserver failed");
+    if(dict->removeHook(model, other, addPrefix) ||
+       dict->removeObserver(model, target, NULL))
+        fail("removed a callback that was not added");
+    if(!dict->removeObserver(model, target, ignore) ||
+       dict->removeObserver(model, target, ignore))
+        fail("removeObserver did not remove the observer once");
+    if(getCounts(kMemHookChain).current <= chains.current)
+        fail("hook chain dropped with a hook left");
+    if(!dict->removeHook(model, target, addPrefix))
+        fail("removeHook did not remove the hook");
+    if(getCounts(kMemHookChain).current != chains.current)
+        fail("empty hook chain is still accounted");
+    dict->setObject(model, value);
+    if(dict->getObject(model) != value)
+        fail("removed hook still rewrites the value");
+    expect("hook removed", kMemRewritten, 0, second, 4, 4);
+
+    // Growing the table is accounted, without counting as an allocation
+    char key[16];
+    for(int i = 0; i < 40; i++) {
+        snprintf(key, sizeof(key), "Key%d", i);
+        const OSSymbol *sym = OSSymbol::withCString(key);
+        dict->setObject(sym, value);
+        sym->release();
+    }
+    const uint64_t grown = memSizeOf(dict);
+    if(grown <= tableBytes)
+        fail("table did not grow");
+    expect("grown", kMemDictionary, grown, grown, 1, 0);
+
+    dict->release();
+    expect("Dictionary freed", kMemDictionary, 0, grown, 1, 1);
+    tables = getCounts(kMemHookTable);
+    if(tables.current || tables.allocs != tables.frees)
+        fail("hook tables still accounted after free");
+    Counts c = getCounts(kMemHookChain);
+    if(c.current != chains.current || c.allocs - chains.allocs !=
+                                      c.frees - chains.frees)
+        fail("hook chains still accounted after free");
+    expect("values freed", kMemRewritten, 0, second, 4, 4);
+
+    longer->release();
+    target->release();
+    other->release();
+    model->release();
+    value->release();
+    props->release();
+    if(shimLiveObjects() != live)
+        fail("%d objects leaked", shimLiveObjects() - live);
+}
+
+int main()
+{
+    testCounters();
+    testDictionary();
+    for(int i = 0; i < kMemCategoryCount; i++) {
+        Counts c = getCounts(static_cast<MemCategory>(i));
+        printf("%-16s current %llu peak %llu allocs %llu frees %llu\n",
+               CATEGORIES[i], (unsigned long long) c.current,
+               (unsigned long long) c.peak, (unsigned long long) c.allocs,
+               (unsigned long long) c.frees);
+        if(c.current || c.allocs != c.frees)
+            fail("'%s' not balanced", CATEGORIES[i]);
+    }
+    return 0;
+}
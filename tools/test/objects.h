@@ -0,0 +1,106 @@
+/*
+ * Copyright (c) 2014, baskingshark
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ *  objects.h
+ *
+ *  Reference counted objects for running CallbackChain on the host.
+ *
+ *  An Object starts with the one reference held by its owner.  A release
+ *  that would drop it to zero while the owner still holds it is a double
+ *  release and fails at once.  After the owner is done with the chain,
+ *  every Object must be back to one reference, or something leaked.
+ */
+
+#ifndef __objects__
+#define __objects__
+
+#include <stdlib.h>
+#include "../../RenameDisk/CallbackChain.h"
+#include "harness.h"
+
+struct Object {
+    int id;
+    int refs;
+};
+
+typedef const Object *(*RewriteFn)(const Object *target,
+                                   int           key,
+                                   const Object *value);
+typedef void (*ObserveFn)(const Object *target,
+                          int           key,
+                          const Object *value);
+
+struct ObjectTraits {
+    typedef const Object *Value;
+    typedef const Object *Target;
+    typedef int           Key;
+    typedef RewriteFn     Rewrite;
+    typedef ObserveFn     Observe;
+
+    static void retain(const Object *obj)
+    {
+        const_cast<Object*>(obj)->refs++;
+    }
+    static void release(const Object *obj)
+    {
+        if(--const_cast<Object*>(obj)->refs < 1)
+            fail("object %d released more than retained", obj->id);
+    }
+    static void *alloc(size_t size)
+    {
+        return malloc(size);
+    }
+    static void free(void *address, size_t size)
+    {
+        (void) size;
+        ::free(address);
+    }
+    template<class Entry>
+    static Value rewrite(const Entry *e, Key aKey, Value aValue)
+    {
+        return (*e->rewrite)(e->target, aKey, aValue);
+    }
+    template<class Entry>
+    static void observe(const Entry *e, Key aKey, Value aValue)
+    {
+        (*e->observe)(e->target, aKey, aValue);
+    }
+};
+
+typedef CallbackChain<ObjectTraits> ObjectChain;
+
+/*
+ * Check that each of the n objects is back to its owner's reference.
+ */
+static inline void checkBalanced(const Object *objects, int n)
+{
+    for(int i = 0; i < n; i++)
+        if(objects[i].refs != 1)
+            fail("object %d has %d references, expected 1",
+                 objects[i].id, objects[i].refs);
+}
+
+#endif /* defined(__objects__) */
@@ -0,0 +1,119 @@
+/*
+ * Copyright (c) 2014, baskingshark
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ *  rewrite_fuzz.cpp
+ *
+ *  Fuzz target for the prefix matching and formatting used by fixModel.
+ *
+ *  The first byte of the input selects the length of a run-time prefix,
+ *  taken from the following bytes, and the rest is the Model.  Both the
+ *  run-time prefix and a prefix declared with DECLARE_PREFIX are checked
+ *  against a plain reference, within a time budget and without allocating.
+ *
+ *  The prefix, Model and output each get an allocation of their own with no
+ *  spare bytes, so AddressSanitizer reports any access past their ends.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "../../RenameDisk/Rewrite.h"
+#include "harness.h"
+
+DECLARE_PREFIX(FixedPrefix, "APPLE SSD");
+
+// Budget for matching or formatting a single Model.  fixModel runs with the
+// property lock held, so anything close to this is already far too slow.
+static const uint64_t OP_BUDGET_NS = 10000;
+
+template<class Prefix>
+static void check(const Prefix &prefix, const char *model, size_t len)
+{
+    const size_t plen = prefix.length();
+    const bool expected = len >= plen && !memcmp(prefix.text(), model, plen);
+    bool matched = false;
+    withinBudget("prefixMatches", OP_BUDGET_NS, 0, [&] {
+        matched = prefixMatches(prefix, model, len);
+    });
+    if(matched != expected)
+        fail("prefixMatches('%.*s', %zu bytes) returned %d",
+             (int) plen, prefix.text(), len, matched);
+
+    // fixModel leaves longer Models untouched
+    if(len > MAX_MODEL_LENGTH)
+        return;
+    const size_t size = plen + len + 4;
+    if(size > MAX_REWRITE_LENGTH)
+        fail("rewriting %zu bytes with a %zu byte prefix needs %zu bytes, "
+             "fixModel has %zu", len, plen, size, MAX_REWRITE_LENGTH);
+    char *out = static_cast<char*>(malloc(size));
+    if(!out)
+        fail("out of memory");
+    withinBudget("rewriteModel", OP_BUDGET_NS, 0, [&] {
+        rewriteModel(prefix, out, model, len);
+    });
+    if(memcmp(out, prefix.text(), plen) ||
+       out[plen] != ' ' || out[plen + 1] != '(' ||
+       memcmp(out + plen + 2, model, len) ||
+       out[plen + 2 + len] != ')' || out[plen + 3 + len] != '\0')
+        fail("rewriteModel('%.*s', %zu bytes) is not \"<prefix> (<model>)\"",
+             (int) plen, prefix.text(), len);
+    // A rewritten Model must never be rewritten again
+    if(!prefixMatches(prefix, out, size - 1))
+        fail("rewritten Model does not start with '%.*s'",
+             (int) plen, prefix.text());
+    free(out);
+}
+
+/*
+ * Copy n bytes to an allocation of exactly that size.
+ */
+static char *copyExact(const uint8_t *data, size_t n)
+{
+    char *result = static_cast<char*>(malloc(n ? n : 1));
+    if(!result)
+        fail("out of memory");
+    memcpy(result, data, n);
+    return result;
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+    if(!size)
+        return 0;
+    size_t plen = data[0] % (MAX_PREFIX_LENGTH + 1);
+    if(plen > size - 1)
+        plen = size - 1;
+    char *prefix = copyExact(data + 1, plen);
+    char *model = copyExact(data + 1 + plen, size - 1 - plen);
+    size_t len = size - 1 - plen;
+
+    check(RuntimePrefix(prefix, plen), model, len);
+    check(FixedPrefix(), model, len);
+
+    free(model);
+    free(prefix);
+    return 0;
+}
@@ -0,0 +1,2 @@
+/* Host build, see shim.h */
+#include "../shim.h"
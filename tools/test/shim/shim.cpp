@@ -0,0 +1,604 @@
+/*
+ * Copyright (c) 2014, baskingshark
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ *  shim.cpp
+ *
+ *  Host implementation of the libkern and IOKit subset declared in shim.h.
+ */
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <time.h>
+#include "shim.h"
+
+static int liveObjects;
+static unsigned long logCount;
+
+int shimLiveObjects()
+{
+    return liveObjects;
+}
+
+unsigned long shimLogCount()
+{
+    return logCount;
+}
+
+void shimFail(const char *fmt, ...)
+{
+    va_list ap;
+    va_start(ap, fmt);
+    fputs("FAILED: ", stderr);
+    vfprintf(stderr, fmt, ap);
+    fputc('\n', stderr);
+    va_end(ap);
+    abort();
+}
+
+void IOLog(const char *format, ...)
+{
+    logCount++;
+    if(!getenv("SHIM_IOLOG"))
+        return;
+    va_list ap;
+    va_start(ap, format);
+    vfprintf(stderr, format, ap);
+    va_end(ap);
+}
+
+void *IOMalloc(vm_size_t size)
+{
+    return malloc(size);
+}
+
+void IOFree(void *address, vm_size_t size)
+{
+    (void) size;
+    free(address);
+}
+
+void clock_get_uptime(uint64_t *result)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    *result = (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+void absolutetime_to_nanoseconds(uint64_t abstime, uint64_t *result)
+{
+    *result = abstime;
+}
+
+//
+// OSObject
+//
+
+const OSMetaClass OSObject::gMetaClass("OSObject", NULL, sizeof(OSObject));
+
+OSObject::OSObject() : retainCount(1)
+{
+    liveObjects++;
+}
+
+OSObject::~OSObject()
+{
+    liveObjects--;
+}
+
+void *OSObject::operator new(size_t size)
+{
+    void *result = calloc(1, size);
+    if(!result)
+        shimFail("out of memory");
+    return result;
+}
+
+void OSObject::operator delete(void *mem)
+{
+    ::free(mem);
+}
+
+void OSObject::retain() const
+{
+    if(retainCount < 1)
+        shimFail("%s %p retained after being freed",
+                 getMetaClass()->getClassName(), this);
+    retainCount++;
+}
+
+void OSObject::release() const
+{
+    if(retainCount < 1)
+        shimFail("%s %p released more than retained",
+                 getMetaClass()->getClassName(), this);
+    if(!--retainCount)
+        const_cast<OSObject*>(this)->free();
+}
+
+int OSObject::getRetainCount() const
+{
+    return retainCount;
+}
+
+void OSObject::free()
+{
+    delete this;
+}
+
+//
+// OSString
+//
+
+OSDefineMetaClassAndStructors(OSString, OSObject)
+
+OSString *OSString::withCString(const char *cString)
+{
+    OSString *me = OSTypeAlloc(OSString);
+    if(me && !me->initWithCString(cString))
+        OSSafeReleaseNULL(me);
+    return me;
+}
+
+OSString *OSString::withCStringNoCopy(const char *cString)
+{
+    OSString *me = OSTypeAlloc(OSString);
+    if(me && !me->initWithCStringNoCopy(cString))
+        OSSafeReleaseNULL(me);
+    return me;
+}
+
+bool OSString::initWithCString(const char *cString)
+{
+    if(!cString || !init())
+        return false;
+    length = strlen(cString);
+    string = static_cast<char*>(malloc(length + 1));
+    if(!string)
+        return false;
+    memcpy(string, cString, length + 1);
+    return true;
+}
+
+bool OSString::initWithCStringNoCopy(const char *cString)
+{
+    if(!cString || !init())
+        return false;
+    length = strlen(cString);
+    string = const_cast<char*>(cString);
+    noCopy = true;
+    return true;
+}
+
+void OSString::free()
+{
+    if(!noCopy)
+        ::free(string);
+    OSObject::free();
+}
+
+unsigned int OSString::getLength() const
+{
+    return length;
+}
+
+const char *OSString::getCStringNoCopy() const
+{
+    return string;
+}
+
+bool OSString::isEqualTo(const char *aCString) const
+{
+    return aCString && !strcmp(string, aCString);
+}
+
+bool OSString::isEqualTo(const OSString *aString) const
+{
+    return aString && aString->length == length &&
+           !memcmp(aString->string, string, length);
+}
+
+bool OSString::isEqualTo(const OSMetaClassBase *anObject) const
+{
+    return isEqualTo(OSDynamicCast(OSString, anObject));
+}
+
+//
+// OSSymbol
+//
+
+OSDefineMetaClassAndStructors(OSSymbol, OSString)
+
+// Existing symbols, each unique by name
+static const OSSymbol *symbols[1024];
+static unsigned int symbolCount;
+
+static const OSSymbol *findSymbol(const char *cString)
+{
+    for(unsigned int i = 0; i < symbolCount; i++)
+        if(symbols[i]->isEqualTo(cString)) {
+            symbols[i]->retain();
+            return symbols[i];
+        }
+    return NULL;
+}
+
+static const OSSymbol *newSymbol(OSSymbol *me, bool ok)
+{
+    if(!ok) {
+        me->release();
+        return NULL;
+    }
+    if(symbolCount == sizeof(symbols) / sizeof(symbols[0]))
+        shimFail("too many symbols");
+    symbols[symbolCount++] = me;
+    return me;
+}
+
+const OSSymbol *OSSymbol::withCString(const char *cString)
+{
+    const OSSymbol *result = findSymbol(cString);
+    if(result)
+        return result;
+    OSSymbol *me = OSTypeAlloc(OSSymbol);
+    return newSymbol(me, me->initWithCString(cString));
+}
+
+const OSSymbol *OSSymbol::withCStringNoCopy(const char *cString)
+{
+    const OSSymbol *result = findSymbol(cString);
+    if(result)
+        return result;
+    OSSymbol *me = OSTypeAlloc(OSSymbol);
+    return newSymbol(me, me->initWithCStringNoCopy(cString));
+}
+
+const OSSymbol *OSSymbol::withString(const OSString *aString)
+{
+    return aString ? withCString(aString->getCStringNoCopy()) : NULL;
+}
+
+void OSSymbol::free()
+{
+    for(unsigned int i = 0; i < symbolCount; i++)
+        if(symbols[i] == this) {
+            symbols[i] = symbols[--symbolCount];
+            break;
+        }
+    OSString::free();
+}
+
+//
+// OSNumber
+//
+
+OSDefineMetaClassAndStructors(OSNumber, OSObject)
+
+OSNumber *OSNumber::withNumber(unsigned long long value,
+                               unsigned int       numberOfBits)
+{
+    OSNumber *me = OSTypeAlloc(OSNumber);
+    if(me) {
+        me->value = value;
+        me->bits = numberOfBits;
+    }
+    return me;
+}
+
+unsigned long long OSNumber::unsigned64BitValue() const
+{
+    return value;
+}
+
+unsigned int OSNumber::numberOfBits() const
+{
+    return bits;
+}
+
+//
+// OSData
+//
+
+OSDefineMetaClassAndStructors(OSData, OSObject)
+
+OSData *OSData::withBytes(const void *bytes, unsigned int numBytes)
+{
+    OSData *me = OSTypeAlloc(OSData);
+    if(me) {
+        me->data = malloc(numBytes ? numBytes : 1);
+        if(!me->data)
+            OSSafeReleaseNULL(me);
+        else {
+            memcpy(me->data, bytes, numBytes);
+            me->length = numBytes;
+        }
+    }
+    return me;
+}
+
+void OSData::free()
+{
+    ::free(data);
+    OSObject::free();
+}
+
+unsigned int OSData::getLength() const
+{
+    return length;
+}
+
+unsigned int OSData::getCapacity() const
+{
+    return length;
+}
+
+const void *OSData::getBytesNoCopy() const
+{
+    return data;
+}
+
+//
+// OSCollection
+//
+
+OSDefineMetaClassAndStructors(OSCollection, OSObject)
+
+//
+// OSDictionary
+//
+
+OSDefineMetaClassAndStructors(OSDictionary, OSCollection)
+
+OSDictionary *OSDictionary::withCapacity(unsigned int capacity)
+{
+    OSDictionary *me = OSTypeAlloc(OSDictionary);
+    if(me && !me->initWithCapacity(capacity))
+        OSSafeReleaseNULL(me);
+    return me;
+}
+
+OSDictionary *OSDictionary::withDictionary(const OSDictionary *dict,
+                                           unsigned int        capacity)
+{
+    OSDictionary *me = OSTypeAlloc(OSDictionary);
+    if(me && !me->initWithDictionary(dict, capacity))
+        OSSafeReleaseNULL(me);
+    return me;
+}
+
+bool OSDictionary::initWithCapacity(unsigned int inCapacity)
+{
+    if(!init())
+        return false;
+    if(inCapacity) {
+        entries = static_cast<Entry*>(calloc(inCapacity, sizeof(Entry)));
+        if(!entries)
+            return false;
+    }
+    capacity = inCapacity;
+    capacityIncrement = inCapacity ? inCapacity : 16;
+    return true;
+}
+
+bool OSDictionary::initWithDictionary(const OSDictionary *dict,
+                                      unsigned int        inCapacity)
+{
+    if(!dict)
+        return false;
+    if(!initWithCapacity(dict->count > inCapacity ? dict->count : inCapacity))
+        return false;
+    // Copies the stored slots, as libkern does, without calling setObject
+    for(unsigned int i = 0; i < dict->count; i++) {
+        entries[i] = dict->entries[i];
+        entries[i].key->retain();
+        entries[i].value->retain();
+    }
+    count = dict->count;
+    return true;
+}
+
+void OSDictionary::free()
+{
+    flushCollection();
+    ::free(entries);
+    OSCollection::free();
+}
+
+unsigned int OSDictionary::getCount() const
+{
+    return count;
+}
+
+unsigned int OSDictionary::getCapacity() const
+{
+    return capacity;
+}
+
+unsigned int OSDictionary::ensureCapacity(unsigned int newCapacity)
+{
+    if(newCapacity <= capacity)
+        return capacity;
+    unsigned int finalCapacity = ((newCapacity - 1) / capacityIncrement + 1) *
+                                 capacityIncrement;
+    Entry *newEntries =
+        static_cast<Entry*>(realloc(entries, finalCapacity * sizeof(Entry)));
+    if(!newEntries)
+        return capacity;
+    entries = newEntries;
+    capacity = finalCapacity;
+    return capacity;
+}
+
+void OSDictionary::flushCollection()
+{
+    for(unsigned int i = 0; i < count; i++) {
+        entries[i].key->release();
+        entries[i].value->release();
+    }
+    count = 0;
+}
+
+int OSDictionary::find(const char *aKey) const
+{
+    for(unsigned int i = 0; i < count; i++)
+        if(entries[i].key->isEqualTo(aKey))
+            return i;
+    return -1;
+}
+
+bool OSDictionary::setObject(const OSSymbol        *aKey,
+                             const OSMetaClassBase *anObject)
+{
+    if(!aKey || !anObject)
+        return false;
+    int i = find(aKey->getCStringNoCopy());
+    if(i >= 0) {
+        const OSMetaClassBase *old = entries[i].value;
+        anObject->retain();
+        entries[i].value = anObject;
+        old->release();
+        return true;
+    }
+    if(count >= ensureCapacity(count + 1))
+        return false;
+    aKey->retain();
+    anObject->retain();
+    entries[count].key = aKey;
+    entries[count].value = anObject;
+    count++;
+    return true;
+}
+
+bool OSDictionary::setObject(const OSString        *aKey,
+                             const OSMetaClassBase *anObject)
+{
+    const OSSymbol *sym = OSSymbol::withString(aKey);
+    if(!sym)
+        return false;
+    bool result = setObject(sym, anObject);
+    sym->release();
+    return result;
+}
+
+bool OSDictionary::setObject(const char            *aKey,
+                             const OSMetaClassBase *anObject)
+{
+    const OSSymbol *sym = OSSymbol::withCString(aKey);
+    if(!sym)
+        return false;
+    bool result = setObject(sym, anObject);
+    sym->release();
+    return result;
+}
+
+void OSDictionary::removeObject(const OSSymbol *aKey)
+{
+    if(!aKey)
+        return;
+    int i = find(aKey->getCStringNoCopy());
+    if(i < 0)
+        return;
+    Entry removed = entries[i];
+    count--;
+    memmove(&entries[i], &entries[i + 1], (count - i) * sizeof(Entry));
+    removed.key->release();
+    removed.value->release();
+}
+
+void OSDictionary::removeObject(const OSString *aKey)
+{
+    const OSSymbol *sym = OSSymbol::withString(aKey);
+    if(sym) {
+        removeObject(sym);
+        sym->release();
+    }
+}
+
+void OSDictionary::removeObject(const char *aKey)
+{
+    const OSSymbol *sym = OSSymbol::withCString(aKey);
+    if(sym) {
+        removeObject(sym);
+        sym->release();
+    }
+}
+
+OSObject *OSDictionary::getObject(const OSSymbol *aKey) const
+{
+    return aKey ? getObject(aKey->getCStringNoCopy()) : NULL;
+}
+
+OSObject *OSDictionary::getObject(const OSString *aKey) const
+{
+    return aKey ? getObject(aKey->getCStringNoCopy()) : NULL;
+}
+
+OSObject *OSDictionary::getObject(const char *aKey) const
+{
+    int i = aKey ? find(aKey) : -1;
+    if(i < 0)
+        return NULL;
+    return const_cast<OSObject*>(
+        static_cast<const OSObject*>(entries[i].value));
+}
+
+const OSSymbol *OSDictionary::getKey(unsigned int index) const
+{
+    return index < count ? entries[index].key : NULL;
+}
+
+//
+// OSCollectionIterator
+//
+
+OSDefineMetaClassAndStructors(OSCollectionIterator, OSObject)
+
+OSCollectionIterator *
+OSCollectionIterator::withCollection(const OSCollection *inColl)
+{
+    const OSDictionary *dict = OSDynamicCast(OSDictionary, inColl);
+    if(!dict)
+        return NULL;
+    OSCollectionIterator *me = OSTypeAlloc(OSCollectionIterator);
+    if(me) {
+        dict->retain();
+        me->collection = dict;
+    }
+    return me;
+}
+
+void OSCollectionIterator::free()
+{
+    OSSafeRelease(collection);
+    OSObject::free();
+}
+
+OSObject *OSCollectionIterator::getNextObject()
+{
+    const OSSymbol *key = collection->getKey(next);
+    if(key)
+        next++;
+    return const_cast<OSSymbol*>(key);
+}
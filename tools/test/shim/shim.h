@@ -0,0 +1,326 @@
+/*
+ * Copyright (c) 2014, baskingshark
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ *  shim.h
+ *
+ *  Just enough of libkern and IOKit to build the kext's Dictionary, MemStats
+ *  and hooks on the host, with reference counts that are checked.
+ *
+ *  Objects are allocated zeroed, as in the kernel.  Releasing an object that
+ *  has no references left fails at once, and shimLiveObjects lets a test check
+ *  that everything it created was freed.  The individual headers under
+ *  IOKit/, kern/ and libkern/ only include this one.
+ */
+
+#ifndef __shim__
+#define __shim__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef int8_t   SInt8;
+typedef uint8_t  UInt8;
+typedef int16_t  SInt16;
+typedef uint16_t UInt16;
+typedef int32_t  SInt32;
+typedef uint32_t UInt32;
+typedef int64_t  SInt64;
+typedef uint64_t UInt64;
+typedef size_t   vm_size_t;
+typedef uint32_t IOOptionBits;
+typedef int      IOReturn;
+
+#define kIOReturnSuccess        0
+
+/*
+ * Test interface
+ */
+
+// Objects allocated and not yet freed
+int shimLiveObjects();
+
+// Calls to IOLog so far.  Messages are only printed if SHIM_IOLOG is set.
+unsigned long shimLogCount();
+
+// Value of a counter of the statistics page, see stats.cpp
+uint64_t shimStatsCounter(int counter);
+
+// Report a misuse of the shim and abort
+__attribute__((noreturn, format(printf, 1, 2)))
+void shimFail(const char *fmt, ...);
+
+/*
+ * IOKit/IOLib.h
+ */
+
+void IOLog(const char *format, ...);
+void *IOMalloc(vm_size_t size);
+void IOFree(void *address, vm_size_t size);
+
+/*
+ * kern/clock.h, with absolute time in nanoseconds
+ */
+
+void clock_get_uptime(uint64_t *result);
+void absolutetime_to_nanoseconds(uint64_t abstime, uint64_t *result);
+
+/*
+ * libkern/OSAtomic.h
+ */
+
+inline SInt64 OSAddAtomic64(SInt64 amount, volatile SInt64 *address)
+{
+    return __atomic_fetch_add(address, amount, __ATOMIC_SEQ_CST);
+}
+
+inline SInt64 OSIncrementAtomic64(volatile SInt64 *address)
+{
+    return OSAddAtomic64(1, address);
+}
+
+inline bool OSCompareAndSwap64(UInt64 oldValue, UInt64 newValue,
+                               volatile UInt64 *address)
+{
+    return __sync_bool_compare_and_swap(address, oldValue, newValue);
+}
+
+inline void OSMemoryBarrier()
+{
+    __sync_synchronize();
+}
+
+/*
+ * libkern/c++
+ */
+
+class OSMetaClass {
+public:
+    OSMetaClass(const char        *className,
+                const OSMetaClass *superClass,
+                unsigned int       classSize)
+        : name(className), super(superClass), size(classSize) {}
+    const char *getClassName() const { return name; }
+    unsigned int getClassSize() const { return size; }
+    const OSMetaClass *getSuperClass() const { return super; }
+private:
+    const char        *name;
+    const OSMetaClass *super;
+    unsigned int       size;
+};
+
+class OSMetaClassBase {
+public:
+    virtual void retain() const = 0;
+    virtual void release() const = 0;
+    virtual int getRetainCount() const = 0;
+    virtual const OSMetaClass *getMetaClass() const = 0;
+    virtual bool isEqualTo(const OSMetaClassBase *anObject) const
+    {
+        return this == anObject;
+    }
+protected:
+    virtual ~OSMetaClassBase() {}
+};
+
+#define OSDeclareDefaultStructors(className)                                \
+public:                                                                     \
+    static const OSMetaClass gMetaClass;                                    \
+    virtual const OSMetaClass *getMetaClass() const { return &gMetaClass; } \
+    className();                                                            \
+protected:                                                                  \
+    virtual ~className()
+
+#define OSDefineMetaClassAndStructors(className, superclassName)            \
+    const OSMetaClass className::gMetaClass(#className,                     \
+                                            &superclassName::gMetaClass,    \
+                                            sizeof(className));             \
+    className::className() {}                                               \
+    className::~className() {}
+
+#define OSTypeAlloc(type) (new type)
+
+template<class T>
+inline T *shimDynamicCast(const OSMetaClassBase *inst)
+{
+    return inst ? dynamic_cast<T*>(const_cast<OSMetaClassBase*>(inst)) : NULL;
+}
+
+#define OSDynamicCast(type, inst) shimDynamicCast<type>(inst)
+
+#define OSSafeRelease(inst) \
+    do { if(inst) (inst)->release(); } while(0)
+#define OSSafeReleaseNULL(inst) \
+    do { if(inst) (inst)->release(); (inst) = NULL; } while(0)
+
+class OSObject : public OSMetaClassBase {
+public:
+    static const OSMetaClass gMetaClass;
+    virtual const OSMetaClass *getMetaClass() const { return &gMetaClass; }
+    OSObject();
+    virtual bool init() { return true; }
+    virtual void retain() const;
+    virtual void release() const;
+    virtual int getRetainCount() const;
+    virtual void free();
+
+    static void *operator new(size_t size);
+    static void operator delete(void *mem);
+protected:
+    virtual ~OSObject();
+private:
+    mutable int retainCount;
+};
+
+class OSString : public OSObject {
+    OSDeclareDefaultStructors(OSString);
+public:
+    static OSString *withCString(const char *cString);
+    static OSString *withCStringNoCopy(const char *cString);
+    virtual bool initWithCString(const char *cString);
+    virtual bool initWithCStringNoCopy(const char *cString);
+    virtual void free();
+    virtual unsigned int getLength() const;
+    virtual const char *getCStringNoCopy() const;
+    virtual bool isEqualTo(const char *aCString) const;
+    virtual bool isEqualTo(const OSString *aString) const;
+    virtual bool isEqualTo(const OSMetaClassBase *anObject) const;
+protected:
+    char         *string;
+    unsigned int  length;
+    bool          noCopy;
+};
+
+class OSSymbol : public OSString {
+    OSDeclareDefaultStructors(OSSymbol);
+public:
+    // Symbols are unique, these return the existing one if there is one
+    static const OSSymbol *withCString(const char *cString);
+    static const OSSymbol *withCStringNoCopy(const char *cString);
+    static const OSSymbol *withString(const OSString *aString);
+    virtual void free();
+};
+
+class OSNumber : public OSObject {
+    OSDeclareDefaultStructors(OSNumber);
+public:
+    static OSNumber *withNumber(unsigned long long value,
+                                unsigned int       numberOfBits);
+    virtual unsigned long long unsigned64BitValue() const;
+    virtual unsigned int numberOfBits() const;
+private:
+    unsigned long long value;
+    unsigned int       bits;
+};
+
+class OSData : public OSObject {
+    OSDeclareDefaultStructors(OSData);
+public:
+    static OSData *withBytes(const void *bytes, unsigned int numBytes);
+    virtual void free();
+    virtual unsigned int getLength() const;
+    virtual unsigned int getCapacity() const;
+    virtual const void *getBytesNoCopy() const;
+private:
+    void         *data;
+    unsigned int  length;
+};
+
+class OSCollection : public OSObject {
+    OSDeclareDefaultStructors(OSCollection);
+public:
+    virtual unsigned int getCount() const = 0;
+    virtual unsigned int getCapacity() const = 0;
+};
+
+/*
+ * The capacity grows as in libkern, by the initial capacity (or 16) at a
+ * time, so that the memory accounting sees the same growth pattern.
+ */
+class OSDictionary : public OSCollection {
+    OSDeclareDefaultStructors(OSDictionary);
+public:
+    static OSDictionary *withCapacity(unsigned int capacity);
+    static OSDictionary *withDictionary(const OSDictionary *dict,
+                                        unsigned int        capacity = 0);
+    virtual bool initWithCapacity(unsigned int capacity);
+    virtual bool initWithDictionary(const OSDictionary *dict,
+                                    unsigned int        capacity = 0);
+    virtual void free();
+    virtual unsigned int getCount() const;
+    virtual unsigned int getCapacity() const;
+    virtual unsigned int ensureCapacity(unsigned int newCapacity);
+    virtual void flushCollection();
+
+    // The other overloads create a symbol and call the OSSymbol one
+    virtual bool setObject(const OSSymbol        *aKey,
+                           const OSMetaClassBase *anObject);
+    virtual bool setObject(const OSString        *aKey,
+                           const OSMetaClassBase *anObject);
+    virtual bool setObject(const char            *aKey,
+                           const OSMetaClassBase *anObject);
+    virtual void removeObject(const OSSymbol *aKey);
+    virtual void removeObject(const OSString *aKey);
+    virtual void removeObject(const char *aKey);
+    virtual OSObject *getObject(const OSSymbol *aKey) const;
+    virtual OSObject *getObject(const OSString *aKey) const;
+    virtual OSObject *getObject(const char *aKey) const;
+
+    // Key at index, for OSCollectionIterator
+    const OSSymbol *getKey(unsigned int index) const;
+private:
+    struct Entry {
+        const OSSymbol        *key;
+        const OSMetaClassBase *value;
+    };
+    int find(const char *aKey) const;
+
+    Entry        *entries;
+    unsigned int  count;
+    unsigned int  capacity;
+    unsigned int  capacityIncrement;
+};
+
+class OSCollectionIterator : public OSObject {
+    OSDeclareDefaultStructors(OSCollectionIterator);
+public:
+    // Only dictionaries are supported, their keys are returned
+    static OSCollectionIterator *withCollection(const OSCollection *inColl);
+    virtual void free();
+    virtual OSObject *getNextObject();
+private:
+    const OSDictionary *collection;
+    unsigned int        next;
+};
+
+/*
+ * IOKit/IOMemoryDescriptor.h
+ */
+
+class IOMemoryDescriptor;
+
+#endif /* defined(__shim__) */
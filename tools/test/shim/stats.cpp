@@ -0,0 +1,72 @@
+/*
+ * Copyright (c) 2014, baskingshark
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ *  stats.cpp
+ *
+ *  Host version of the kext's statistics, see Stats.h.
+ *
+ *  Counters are kept so that tests can check them.  Phases and disk states
+ *  are not recorded, and there is no page to map.
+ */
+
+#include "shim.h"
+#include "../../../RenameDisk/Stats.h"
+
+static uint64_t counters[kStatsCounterCount];
+
+uint64_t shimStatsCounter(int counter)
+{
+    return counters[counter];
+}
+
+void statsCount(StatsCounter counter)
+{
+    counters[counter]++;
+}
+
+uint64_t statsStart()
+{
+    uint64_t now;
+    clock_get_uptime(&now);
+    return now;
+}
+
+void statsPhase(StatsPhase phase, uint64_t start)
+{
+    (void) phase;
+    (void) start;
+}
+
+void statsDiskState(const OSString *serial, StatsDiskState state)
+{
+    (void) serial;
+    (void) state;
+}
+
+IOMemoryDescriptor *statsCopyDescriptor()
+{
+    return NULL;
+}
@@ -0,0 +1,194 @@
+/*
+ * Copyright (c) 2014, baskingshark
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ *  statsread_test.c
+ *
+ *  Run the statistics page reader against a page in ordinary memory while
+ *  writer threads update it the way Stats.cpp does.
+ *
+ *  Every update changes all counters and phases together, so a snapshot
+ *  that mixes two updates shows up as counters that disagree.  The writers
+ *  keep going until the reader has taken all its snapshots, so that every
+ *  snapshot races with them.
+ */
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../statsread.h"
+
+// Snapshots taken while the writers are running
+static const uint64_t SNAPSHOTS = 100000;
+
+// The reader yields after this many snapshots and the writers after each
+// update, so that they interleave even on a single CPU
+static const uint64_t SNAPSHOTS_PER_YIELD = 8;
+
+// Writers also yield halfway through one update in this many, so that the
+// reader sees updates in progress as it would from another CPU
+static const uint64_t UPDATES_PER_PARTIAL = 64;
+
+// Number of writer threads
+#define WRITERS 2
+
+static volatile StatsPage *page;
+
+// Set by the reader once it is done
+static volatile int stop;
+
+// Stands in for the IOSimpleLock serializing writers in the kext
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * Update the page as beginWrite and endWrite in Stats.cpp do.
+ */
+static void update(uint64_t ns)
+{
+    pthread_mutex_lock(&lock);
+    statsPageBeginWrite(page);
+    for(int i = 0; i < kStatsCounterCount; i++)
+        page->counters[i]++;
+    if(!(ns % UPDATES_PER_PARTIAL))
+        sched_yield();
+    for(int i = 0; i < kStatsPhaseCount; i++) {
+        page->phases[i].count++;
+        page->phases[i].totalNs += ns;
+        if(ns > page->phases[i].maxNs)
+            page->phases[i].maxNs = ns;
+    }
+    page->disks[0].restarts++;
+    statsPageEndWrite(page);
+    pthread_mutex_unlock(&lock);
+}
+
+static void *writer(void *arg)
+{
+    uint64_t *updates = arg;
+    while(!stop) {
+        update(++*updates);
+        sched_yield();
+    }
+    return NULL;
+}
+
+/*
+ * Check that a snapshot holds a whole number of updates.
+ */
+static int consistent(const StatsPage *s)
+{
+    uint64_t n = s->counters[0];
+    if(s->sequence & 1)
+        return 0;
+    if(s->sequence != 2 * n)
+        return 0;
+    for(int i = 1; i < kStatsCounterCount; i++)
+        if(s->counters[i] != n)
+            return 0;
+    for(int i = 0; i < kStatsPhaseCount; i++) {
+        if(s->phases[i].count != n ||
+           s->phases[i].totalNs != s->phases[0].totalNs ||
+           s->phases[i].maxNs != s->phases[0].maxNs)
+            return 0;
+    }
+    return s->disks[0].restarts == n;
+}
+
+int main(void)
+{
+    size_t size = (sizeof(StatsPage) + 4095) & ~(size_t) 4095;
+    StatsPage *storage = aligned_alloc(4096, size);
+    if(!storage) {
+        fprintf(stderr, "failed to allocate page\n");
+        return 1;
+    }
+    memset(storage, 0, size);
+    storage->version = RENAMEDISK_STATS_VERSION;
+    storage->size = sizeof(StatsPage);
+    storage->diskCount = 1;
+    strcpy(storage->disks[0].serial, "MOCK0001");
+    storage->disks[0].state = kStatsDiskRunning;
+    page = storage;
+
+    pthread_t threads[WRITERS];
+    uint64_t updates[WRITERS] = { 0 };
+    for(int i = 0; i < WRITERS; i++)
+        pthread_create(&threads[i], NULL, writer, &updates[i]);
+
+    StatsPage copy;
+    uint64_t last = 0;
+    uint64_t changes = 0;
+    int failed = 0;
+    for(uint64_t i = 0; i < SNAPSHOTS; i++) {
+        statsSnapshot(page, &copy);
+        if(!consistent(&copy) || copy.counters[0] < last) {
+            fprintf(stderr, "inconsistent snapshot %llu:\n",
+                    (unsigned long long) i);
+            statsPrint(stderr, &copy);
+            failed = 1;
+            break;
+        }
+        if(copy.counters[0] != last)
+            changes++;
+        last = copy.counters[0];
+        if(!(i % SNAPSHOTS_PER_YIELD))
+            sched_yield();
+    }
+    stop = 1;
+
+    uint64_t total = 0;
+    uint64_t longest = 0;
+    for(int i = 0; i < WRITERS; i++) {
+        pthread_join(threads[i], NULL);
+        total += updates[i];
+        if(updates[i] > longest)
+            longest = updates[i];
+    }
+
+    statsSnapshot(page, &copy);
+    if(!failed && (!consistent(&copy) ||
+                   copy.counters[0] != total ||
+                   copy.phases[0].maxNs != longest)) {
+        fprintf(stderr, "wrong final page:\n");
+        statsPrint(stderr, &copy);
+        failed = 1;
+    }
+    if(!failed && changes < SNAPSHOTS / 100) {
+        fprintf(stderr, "writers only made progress during %llu of %llu "
+                "snapshots\n", (unsigned long long) changes,
+                (unsigned long long) SNAPSHOTS);
+        failed = 1;
+    }
+    if(!failed) {
+        statsPrint(stdout, &copy);
+        printf("%llu snapshots, %llu while the page changed\n",
+               (unsigned long long) SNAPSHOTS,
+               (unsigned long long) changes);
+    }
+    free(storage);
+    return failed;
+}